@@ -4,111 +4,580 @@
 #include "leds.h"
 #include "SpedenSpelit.h"
 #include "pitches.h"
+#include "replay.h"
+#include "timers.h"
+#include "scheduler.h"
+#include "ram.h"
+#include "latency.h"
+#include "board.h"
+#include "game.h"
+#include "settings.h"
+#include "console.h"
 // omia globaaleja
-volatile int painetut_numerot[10]; // painallusten tallentamiseen
-volatile int random_numerot[10]; // generoitujen lukujen 
-volatile int laskin; // timerin muuttamisen laskuri joka nollaantuu 9:ssä ja timeri nopeutuu
-volatile int randNumber;
-volatile int score;
-long timer = 1000000; // init timerin muuttuja jota muokataan ohjelmassa
-volatile int index; // rng listan painamatonta alkiota seuraava numero/indeksi
+// pelaaja: pelin säännöt ja tila (game.h), oma tick ja omat napit/ledit. Yksinpelissä pelaajalla 0 on kaikki napit,
+// kaksinpelissä kummallakin puolet (0 vasemmat, 1 oikeat). Tick koskee vain omaan pelaajaansa, joten tickin kesto ei
+// kasva pelaajien mukana
+struct Player {
+  GameState game; // sytytetyt ja painetut numerot, pisteet, tickin jakso
+  SoftTimer timer; // pelaajan tick, sytyttää uuden ledin
+  uint8_t firstButton; // ensimmäinen oma nappi (ja ledi)
+  uint8_t buttons; // montako nappia
+  uint16_t ledGroup; // omien ledien bitit setLedGroup():lle
+  unsigned long lastEvent; // ms, kaksinpelin vasteaikoja varten (yksinpelissä ne tulevat toistosta)
+};
+void timer1Active();
+void player2Tick();
+Player players[2] = { { {}, { &timer1Active, TIMER_ISR } }, { {}, { &player2Tick, TIMER_ISR } } };
+uint8_t playerCount = 1; // pelaajia käynnissä olevassa pelissä
+// nopeuskäyrät numeroittain, numero tallennetaan toistoon: 0 = kiinteä (10 % nopeammaksi joka 10. osumalla), 1 = mukautuva
+const GameCurve *const gameCurves[] = { &gameCurve, &adaptiveCurve };
+uint16_t pressResponseTime; // ms edellisestä tapahtumasta painallukseen, sellaisena kuin se tallentui toistoon
+unsigned long gameSeed; // pelin satunnaislukujen siemen, tallennetaan toistoa varten
 volatile int gameState = 0;
 
 Display display;
 
+// pelaajien tickit ovat ohjelmallisia ajastimia jotka pyörivät Timer1:n millisekunnin tickin päällä (timers.h)
+void sSegFrame();
+SoftTimer sSegTimer = { &sSegFrame, TIMER_DEFERRED }; // 7-segmenttien rullaavat numerot, ruutu kerrallaan loopissa
+const uint16_t sSegFramePeriod = 40; // ms, numero rullaa uuteen arvoon kolmessa ruudussa
+bool scoreFramePending = false; // pisteet ovat muuttuneet ja viivemittaus odottaa rullauksen ensimmäistä ruutua
+// esittelytila: kun peliä ei ole pelattu hetkeen, EEPROMin paras peli pyörii samojen funktioiden läpi kuin oikea peli
+void startAttract();
+SoftTimer attractTimer = { &startAttract, TIMER_DEFERRED };
+const uint16_t attractDelay = 30000; // ms joutilaana ennen esittelyä
+bool attractMode = false;
+char welcomeMessage[] = "Yhden vai kahdentonnin haaste?"; // välilyönnin puute asettelun vuoksi, on ok näytöllä
+
+// taskit (scheduler.h), heräävät vain kun niille on tekemistä
+uint8_t lcdTaskRun(Task *task);
+uint8_t replayTaskRun(Task *task);
+uint8_t serialTaskRun(Task *task);
+uint8_t ramTaskRun(Task *task);
+uint8_t bootTaskRun(Task *task);
+Task lcdTask = { &lcdTaskRun }; // LCD:n käskyjono, yksi käsky kerrallaan
+Task replayTask = { &replayTaskRun }; // toisto sekä tallennuksen tulostus ja EEPROM
+Task serialTask = { &serialTaskRun }; // sarjaportin komentorivi ja asetusten tallennus
+Task ramTask = { &ramTaskRun }; // varoittaa jos pino kasvaa liian lähelle muuttujia
+Task bootTask = { &bootTaskRun }; // käynnistyksen kiireettömät osat setupin jälkeen
+uint16_t lcdWait; // us, kauanko LCD:n seuraava käsky joutuu odottamaan (taskin välillä, ei saa olla paikallinen)
+uint16_t replayWait; // ms seuraavaan toistettavaan tapahtumaan, samasta syystä globaali
+const uint16_t replaySavePeriod = 4; // ms, EEPROMin tavun kirjoitus ehtii valmiiksi
+const uint16_t serialCheckPeriod = 20; // ms, komennoilla ei ole kiire
+const uint16_t ramCheckPeriod = 1000; // ms
+const unsigned long lcdPowerUpTime = 40; // ms, HD44780 ei ota käskyjä vastaan ennen tätä
+
+// käynnistyksen aikajana mikrosekunteina resetistä (micros() alkaa nollasta ennen setupia, bootloaderin aikaa ei näe)
+unsigned long bootStartLedTime; // start-ledi palaa ja napit toimivat, peliä voi pelata
+unsigned long bootMessageTime; // tervetuloviesti on kokonaan LCD:llä
+bool bootMessagePending = false;
+
 void setup()
 {
   /*
     Initialize here all modules
+    Setupissa tehdään vain se mitä pelaamiseen tarvitaan, näytöt, musiikki ja testit hoitaa bootTask taustalla
   */
   Serial.begin(9600);
-  initializeTimer();
-  Timer1.stop();
+  initializeTimers();
+  initializeScheduler();
   initializeLeds();
+  initializeAudio();
   initButtonsAndButtonInterrupts(&buttonPress, &startButton);
-  display.initializeDisplays(2, 3, 4, 7, 8);
   startButtonLed(1);
-  Serial.println("Setup valmis");
-  // Välilyönnin puute asettelun vuoksi, on ok näytöllä
-  display.writeToLCD("Yhden vai kahdentonnin haaste?");
-  display.clearSSeg();
+  bootStartLedTime = micros();
+
+  taskAdd(&lcdTask, PRIORITY_LCD);
+  taskAdd(&replayTask, PRIORITY_REPLAY);
+  taskAdd(&serialTask, PRIORITY_SERIAL);
+  taskAdd(&ramTask, PRIORITY_RAM);
+  taskAdd(&bootTask, PRIORITY_BOOT);
+}
+
+uint8_t bootTaskRun(Task *task) {
+  PT_BEGIN(task);
+  // asetukset EEPROMin alusta (settings.h), uusi tai rikki mennyt EEPROM antaa oletukset
+  if (!settingsLoad()) {
+    Serial.println("Ei tallennettuja asetuksia, käytetään oletuksia");
+  }
+  setButtonDebounce(settings.debounce);
+  ledBenchmark();
+  buttonBenchmark();
+  // musiikki alkaa heti, ellei joku ole jo ehtinyt painaa starttia
+  if (gameState == 0) {
+    setGameState(0);
+  }
+
+  // LCD tarvitsee hetken virran kytkemisen jälkeen
+  if (millis() < lcdPowerUpTime) {
+    PT_SLEEP(task, lcdPowerUpTime - millis());
+  }
+  display.setLcdWakeFunction(&wakeLcdTask);
+  display.initializeDisplays(); // pinnit board.h:ssa
+  display.setSSegFrameFunction(&startSSegFrames); // vasta alustuksen jälkeen, ensimmäinen nolla näkyy heti
+  if (gameState == 0) {
+    display.writeToLCD(welcomeMessage);
+    bootMessagePending = true;
+    timerStart(&attractTimer, attractDelay, 0);
+  }
+  PT_END(task);
+}
+
+void bootReport() {
+  Serial.print("Käynnistys: peli valmis ");
+  Serial.print(bootStartLedTime);
+  Serial.print(" us, viesti näytöllä ");
+  Serial.print(bootMessageTime);
+  Serial.print(" us resetistä, viimeisin LCD-viesti näytöllä ");
+  Serial.print(display.lcdMessageTime());
+  Serial.println(" us kirjoituksesta");
 }
 
 void loop()
 {
-  buttonsActivated();
-  display.lcdInterruptCheck();
-  gameStateDetect(gameState);
+  // pelin tick ja äänitehosteet hoituvat ajastimilla, napit, LCD, toisto ja sarjaportti taskeina
+  // kun millekään ei ole tekemistä, prosessori nukkuu seuraavaan keskeytykseen asti
+  schedulerRun();
+}
+
+void wakeLcdTask() {
+  taskWake(&lcdTask);
+}
+
+void startSSegFrames() {
+  timerStart(&sSegTimer, 0, sSegFramePeriod);
+}
+
+void sSegFrame() {
+  // ajastin on DEFERRED, joten ruutu ei koskaan osu LCD:n kesken olevan käskyn väliin
+  bool rolling = display.sSegFrame();
+  if (scoreFramePending) {
+    // uuden pisteen ensimmäinen ruutu on näytöllä, pelaaja näkee pisteen muuttuvan
+    scoreFramePending = false;
+    latencyMark(LATENCY_SCORE);
+  }
+  if (!rolling) {
+    timerCancel(&sSegTimer);
+  }
+}
+
+uint8_t lcdTaskRun(Task *task) {
+  // nukkuu kun jono on tyhjä, muuten ajaa käskyjä niin nopeasti kuin LCD ne ottaa (jokaisella käskyllä oma suoritusaikansa)
+  PT_BEGIN(task);
+  for (;;) {
+    PT_WAIT_UNTIL(task, display.lcdInterruptActive);
+    display.lcdInterruptCheck();
+    if (bootMessagePending && !display.lcdInterruptActive) {
+      // jono tyhjeni ensimmäisen kerran, tervetuloviesti näkyy
+      bootMessagePending = false;
+      bootMessageTime = micros();
+      bootReport();
+    }
+    lcdWait = display.lcdWaitTime();
+    if (lcdWait >= 1000) {
+      // clear vie 1.5 ms, sen ajan muut saavat ajaa ja prosessori nukkua
+      PT_SLEEP(task, lcdWait / 1000 + 1);
+    }
+    else {
+      // lyhyt tauko tai purske kesken, annetaan kiireellisempien taskien ajaa välissä
+      PT_YIELD(task);
+    }
+  }
+  PT_END(task);
+}
+
+uint8_t replayTaskRun(Task *task) {
+  // herätetään pelin tapahtumista, pelin loputtua ja toiston alkaessa
+  PT_BEGIN(task);
+  for (;;) {
+    replayCheck();
+    if (replayPlaying()) {
+      // herätään vasta kun seuraava tallennettu tapahtuma on vuorossa, esittely ei pidä prosessoria hereillä
+      replayWait = replayWaitTime();
+      PT_SLEEP(task, replayWait > 0 ? replayWait : 1);
+    }
+    else if (replaySaving()) {
+      // tallennus kirjoitetaan EEPROMiin tavu kerrallaan, tavun kirjoitus vie 3.3 ms eikä sitä jäädä odottamaan
+      PT_SLEEP(task, replaySavePeriod);
+    }
+    else {
+      PT_WAIT_EVENT(task);
+    }
+  }
+  PT_END(task);
+}
+
+uint8_t serialTaskRun(Task *task) {
+  PT_BEGIN(task);
+  for (;;) {
+    // UARTin keskeytys kerää merkit, tässä niitä vain luetaan eteenpäin, mikään ei jää odottamaan
+    if (consoleRead()) {
+      consoleCommand();
+      consoleDone();
+    }
+    settingsCheck(); // muuttuneet asetukset EEPROMiin tavu kerrallaan
+    PT_SLEEP(task, serialCheckPeriod);
+  }
+  PT_END(task);
+}
+
+uint8_t ramTaskRun(Task *task) {
+  PT_BEGIN(task);
+  for (;;) {
+    ramCheck();
+    PT_SLEEP(task, ramCheckPeriod);
+  }
+  PT_END(task);
+}
+
+void setGameState(int state) {
+  // äänet reagoivat tilan muutokseen heti, tilaa ei tarvitse pollata loopissa
+  gameState = state;
+  gameStateDetect(state);
+}
+
+void consoleCommand() {
+  // rivikomennot sarjaportista (rivinvaihto tai 100 ms tauko päättää rivin):
+  //   stats = unen ja herätysviiveen tilastot sekä LCD-jono, hist = viivemittauksen histogrammit, ram = vapaa RAM,
+  //   settings = asetukset, curve fixed|adaptive, players 1|2, debounce <ms>, seed <numero>|random,
+  //   scores = ennätykset, scores clear = tyhjennä ennätykset, help = lista
+  // vanhat yhden merkin komennot toimivat edelleen: d = tulosta tallennus, e = lataa paras peli EEPROMista,
+  //   p = toista tallennus, s = unen ja herätysviiveen tilastot, m = vapaa RAM ja pinon syvin kohta,
+  //   l = viivemittaus päälle/pois (napin reunasta ledin sammumiseen ja pisteiden näyttöön, tulokset kun mittaus lopetetaan),
+  //   b = käynnistyksen aikajana, n = LCD-jonosta pois jätetyt käskyt,
+  //   a = mukautuva vaikeus / kiinteä käyrä, k = kaksinpeli / yksinpeli
+  // asetukset koskevat seuraavaa peliä ja tallentuvat EEPROMiin
+  uint32_t value;
+  if (consoleWords() == 0) {
+    Serial.println("Tuntematon komento, help listaa komennot");
+  }
+  else if (consoleIs(0, "d")) {
+    replayDump();
+  }
+  else if (consoleIs(0, "e")) {
+    if (!replayLoad()) {
+      Serial.println("EEPROMissa ei ole peliä");
+    }
+  }
+  else if (consoleIs(0, "p")) {
+    replayGame();
+  }
+  else if (consoleIs(0, "s")) {
+    schedulerStatsPrint();
+  }
+  else if (consoleIs(0, "stats")) {
+    schedulerStatsPrint();
+    lcdQueueReport();
+  }
+  else if (consoleIs(0, "m") || consoleIs(0, "ram")) {
+    ramReport();
+  }
+  else if (consoleIs(0, "hist")) {
+    latencyReport();
+  }
+  else if (consoleIs(0, "b")) {
+    bootReport();
+  }
+  else if (consoleIs(0, "n")) {
+    lcdQueueReport();
+  }
+  else if (consoleIs(0, "l")) {
+    if (latencyActive()) {
+      latencyStop();
+    }
+    else {
+      latencyStart();
+      Serial.println("Viivemittaus päällä, pelaa ja lopeta l:llä");
+    }
+  }
+  else if (consoleIs(0, "a") || (consoleIs(0, "curve") && (consoleIs(1, "fixed") || consoleIs(1, "adaptive")))) {
+    settings.curve = consoleIs(0, "a") ? (settings.curve == 0 ? 1 : 0) : (consoleIs(1, "adaptive") ? 1 : 0);
+    settingsSave();
+    settingsReport();
+  }
+  else if (consoleIs(0, "k") || (consoleIs(0, "players") && consoleNumber(1, &value) && (value == 1 || value == 2))) {
+    settings.players = consoleIs(0, "k") ? (settings.players == 1 ? 2 : 1) : value;
+    settingsSave();
+    settingsReport();
+  }
+  else if (consoleIs(0, "debounce") && consoleNumber(1, &value) && value >= 1 && value <= 255) {
+    settings.debounce = value;
+    setButtonDebounce(value);
+    settingsSave();
+    settingsReport();
+  }
+  else if (consoleIs(0, "seed") && (consoleIs(1, "random") || consoleNumber(1, &value))) {
+    // kiinteällä siemenellä jokainen peli sytyttää samat ledit samassa järjestyksessä, 0 = uusi siemen joka pelille
+    settings.seed = consoleIs(1, "random") ? 0 : value;
+    settingsSave();
+    settingsReport();
+  }
+  else if (consoleIs(0, "scores") && consoleIs(1, "clear")) {
+    // pelin loppu lisää ennätyksen tickin keskeytyksessä, joten taulukkoa käsitellään vain keskeytykset pois päältä
+    settingsClearScores();
+    Serial.println("Ennätykset tyhjennetty");
+  }
+  else if (consoleIs(0, "scores")) {
+    Settings current = settingsCopy();
+    Serial.print("Ennätykset:");
+    for (uint8_t i = 0; i < SETTINGS_HIGH_SCORES; i++) {
+      Serial.print(' ');
+      Serial.print(current.highScores[i]);
+    }
+    Serial.println();
+  }
+  else if (consoleIs(0, "settings")) {
+    settingsReport();
+  }
+  else if (consoleIs(0, "help")) {
+    Serial.println("stats, hist, ram, settings, curve fixed|adaptive, players 1|2, debounce <ms>, seed <n>|random,");
+    Serial.println("scores, scores clear, d, e, p, s, m, l, b, n, a, k");
+  }
+  else {
+    Serial.println("Tuntematon komento, help listaa komennot");
+  }
+}
+
+void settingsReport() {
+  Settings current = settingsCopy(); // kopio keskeytykset pois päältä, monitavuiset kentät luetaan ehjinä
+  Serial.print("Asetukset: käyrä ");
+  Serial.print(current.curve == 0 ? "kiinteä" : "mukautuva");
+  Serial.print(", pelaajia ");
+  Serial.print(current.players);
+  Serial.print(", debounce ");
+  Serial.print(current.debounce);
+  Serial.print(" ms, siemen ");
+  if (current.seed == 0) {
+    Serial.println("satunnainen");
+  }
+  else {
+    Serial.println(current.seed);
+  }
+}
+
+void lcdQueueReport() {
+  // ennen kuin ehtivät LCD:lle korvautuneet viestit ja turhat tyhjennykset
+  Display::LcdQueueStats stats = display.lcdQueueStats();
+  Serial.print("LCD-jono: tyhjennyksiä yhdistetty ");
+  Serial.print(stats.clearsMerged);
+  Serial.print(", kotiinpaluita pois ");
+  Serial.print(stats.homesMerged);
+  Serial.print(", viestejä peruttu ");
+  Serial.print(stats.writesCancelled);
+  Serial.print(" (");
+  Serial.print(stats.charactersSkipped);
+  Serial.print(" merkkiä), kesken vaihtuneita ");
+  Serial.println(stats.versionAborts);
+}
+
+void replayGame() {
+  // syöttää tallennetun pelin takaisin timer1Active():n ja buttonPress():n kautta
+  if (!replayStartPlayback(&timer1Active, &buttonPress)) {
+    Serial.println("Ei toistettavaa peliä");
+    return;
+  }
+  Serial.println("Toistetaan tallennettu peli");
+  initializeGame();
+  taskWake(&replayTask);
+}
+
+void startAttract() {
+  // toistaa parhaan pelin kuin se pelattaisiin: ledit, pisteet, LCD ja musiikki, mikä tahansa nappi keskeyttää
+  if (gameState == 2 || gameState == 4 || replayPlaying()) {
+    return;
+  }
+  if (!replayLoad() || !replayStartPlayback(&timer1Active, &buttonPress)) {
+    // ei tallennettua peliä, esittelynä valoaalto ledeillä kunnes start aloittaa pelin (clearAllLeds() pysäyttää sen)
+    ledChase(8);
+    return;
+  }
+  Serial.println("Esittelytila");
+  attractMode = true;
+  initializeGame();
+  taskWake(&replayTask);
+}
+
+void attractButton(int buttonInput) {
+  // pelinappi keskeyttää esittelyn ja palaa odottamaan, start aloittaa pelin suoraan (startButton)
+  replayStopPlayback();
+  attractMode = false;
+  disableButtonInterrupts();
+  clearAllLeds();
+  display.clearSSeg();
+  setGameState(0);
+  display.writeToLCD(welcomeMessage);
+  timerStart(&attractTimer, attractDelay, 0);
 }
 
 void timer1Active() {
-  // Sammuttaa kaikki ledit ennen uuden sytytystä
-  setLed(0,0);
-  setLed(1,0);
-  setLed(2,0);
-  setLed(3,0);
+  playerTick(&players[0]);
+}
 
-  int rand_temp;
-  randNumber = random(9,13); // muokkaa rand väli vastaamaan painettujen pinnien arvoja
-  for (int i = 9; i >= 0; i--) { // listan alkioiden oikealle siirto looppi
-    rand_temp = random_numerot[i-1];
-    random_numerot[i] = rand_temp;
+void player2Tick() {
+  playerTick(&players[1]);
+}
+
+void playerTick(Player *player) {
+  GameState *game = &player->game;
+  int target = player->firstButton + random(0, player->buttons); // napit ovat numeroita 0..buttonCount-1 (board.h)
+  bool lost = gameTick(game, target); // uusin numero listan alkuun, painamattomien määrä kasvaa
+  replayTick(target);
+  taskWake(&replayTask); // tallennus EEPROMiin
+  player->lastEvent = millis();
+  setLedGroup((uint16_t)1 << target, player->ledGroup); // sammuttaa pelaajan muut ledit ja sytyttää uuden yhdellä kirjoituksella
+  if (player == &players[0]) {
+    musicTick(game->period); // taustamusiikki pysyy (ensimmäisen) pelaajan tickin tahdissa
+  }
+  if (game->waiting >= 7) {
+    ledPulse(target, 64, 255, 32); // uusi ledi sykkii kun häviämiseen on enää pari tickiä
   }
-  random_numerot[0] = randNumber; // uusimman numeron lisääminen indexiin 0
-  setLed(randNumber - 9, 1); // ledi päälle
-  index++; // rng listan painamattoman numeron seuraaja
-  if (index > 9) {
-    lostTheGame();
+  if (lost) {
+    lostTheGame(player);
   }
 }
 
+Player *buttonPlayer(int button) {
+  // kaksinpelissä napin omistaa se pelaaja jonka alueella se on
+  if (playerCount > 1 && button >= players[1].firstButton) {
+    return &players[1];
+  }
+  return &players[0];
+}
+
 void startButton() {
   Serial.println("Start button");
+  replayStopPlayback();
   startTheGame();
   eyesOfSpede();
 }
 
 void buttonPress(int buttonInput) {
-  //napin painallus, antaa button muuttujalle painetun napin pinnin arvon
-  int paino_temp;
-  for (int i = 9; i >= 0; i--) {
-    paino_temp = painetut_numerot[i-1];
-    painetut_numerot[i] = paino_temp;
-  }
-  painetut_numerot[0] = buttonInput;
+  //napin painallus, antaa button muuttujalle painetun napin numeron
+  buttonSound();
   checkGame(buttonInput);
+  taskWake(&replayTask); // painallus ja mahdollinen jakson muutos tallennukseen
+}
+
+void startPlayerTimer(Player *player) {
+  // pelin tick on ajastinpyörän jaksollinen ajastin, jakso pyöristetään millisekunteihin
+  uint16_t period = (player->game.period + 500) / 1000;
+  if (replayPlaying()) {
+    // toistossa tickit tulevat tallennuksesta
+    timerCancel(&player->timer);
+    return;
+  }
+  timerStart(&player->timer, period, period);
 }
 
 void initializeTimer(void)
 {
 	Serial.println("Timerin valmistelu");
   // see requirements for the function from SpedenSpelit.
-  Timer1.initialize(timer);
-  Timer1.attachInterrupt(&timer1Active, timer);
+  for (uint8_t i = 0; i < playerCount; i++) {
+    startPlayerTimer(&players[i]);
+  }
+}
+
+void showScores() {
+  if (playerCount > 1) {
+    display.writeScores(players[0].game.score, players[1].game.score);
+  }
+  else {
+    display.writeToSSeg(players[0].game.score);
+  }
+}
+
+char *appendNumber(char *text, uint16_t number) {
+  // numero tekstin perään ilman sprintf:ää, palauttaa lopun
+  char digits[5];
+  uint8_t count = 0;
+  do {
+    digits[count++] = '0' + number % 10;
+    number /= 10;
+  } while (number > 0);
+  while (count > 0) {
+    *text++ = digits[--count];
+  }
+  *text = 0;
+  return text;
+}
+
+void scoreMessage(const char *start) {
+  // kaksinpelin pisteet LCD:lle kokonaan, 7-segmenteille mahtuu vain loppu
+  char message[40];
+  char *end = message;
+  while (*start != 0) {
+    *end++ = *start++;
+  }
+  end = appendNumber(end, players[0].game.score);
+  *end++ = '-';
+  appendNumber(end, players[1].game.score);
+  display.writeToLCD(message);
 }
 
 void checkGame(int nbrOfButtonPush)
 {
   // see requirements for the function from SpedenSpelit.h
-  if (random_numerot[index - 1] == painetut_numerot[0]) {
-    score++;
-    laskin++;
-    index--;
-    display.writeToSSeg(score);
-    setLed(nbrOfButtonPush - 9, 0);
-    gameState = 4;
-    // timerin nopeutus | timer globaalia muuttujaa kerrotaan 0.9 ja ajetaan timer init uudestaan keskeytysten tiheyden muuttamiseksi
-    if (laskin == 10) {
-      timer *= 0.9;
-      laskin = 0;
-      display.gameMessage(score);
-      initializeTimer();
-      eyesOfSpede();
-      gameState = 2;
-    }
+  // säännöt ovat game.cpp:ssä, tick muuttaa samaa tilaa keskeytyksestä joten painallus käsitellään keskeytykset pois päältä
+  Player *player = buttonPlayer(nbrOfButtonPush);
+  GameState *game = &player->game;
+  uint8_t oldSREG = SREG;
+  cli();
+  if (playerCount > 1) {
+    // kaksinpeliä ei tallenneta, vasteaika lasketaan pelaajan omasta edellisestä tapahtumasta
+    unsigned long now = millis();
+    pressResponseTime = now - player->lastEvent > 0xFFFF ? 0xFFFF : now - player->lastEvent;
+    player->lastEvent = now;
+  }
+  else {
+    // painallus tallentuu samassa pätkässä jossa se muuttaa tilaa, joten tick ei mahdu niiden väliin ja toisto näkee
+    // tapahtumat samassa järjestyksessä kuin peli
+    pressResponseTime = replayPress(nbrOfButtonPush);
+  }
+  long oldPeriod = game->period;
+  uint8_t result = gamePress(game, nbrOfButtonPush, pressResponseTime);
+  SREG = oldSREG;
+  if (result == GAME_MISS) {
+    // väärä nappi, tai ei yhtään sytytettyä ledia
+    lostTheGame(player);
+    return;
+  }
+  showScores();
+  if (display.sSegRolls()) {
+    // rullaus lähettää uuden pisteen vasta seuraavassa ruudussa (heti, tai enintään ruudun jakson päästä jos edellinen
+    // rullaus on kesken), joten pisteiden viive mitataan siihen ruutuun
+    scoreFramePending = true;
   }
   else {
-    lostTheGame();
+    latencyMark(LATENCY_SCORE);
+  }
+  setLed(nbrOfButtonPush, 0);
+  latencyMark(LATENCY_LED);
+  setGameState(4);
+  if (game->period != oldPeriod) {
+    if (game->curve->targetLag > 0) {
+      // mukautuva käyrä säätää jaksoa joka osumalla, odottava tick pitää aikansa ja uusi jakso alkaa sen jälkeen
+      // jaksoa ei tallenneta, se lasketaan toistossa samoista painalluksista (tallennus täyttyisi muutoksista)
+      replaySetPeriod(game->period);
+      if (!replayPlaying()) {
+        timerSetPeriod(&player->timer, (game->period + 500) / 1000);
+      }
+    }
+    else {
+      // timerin nopeutus | joka 10. osumalla jakso on lyhentynyt 10 %, käynnistetään pelaajan tick uudestaan uudella jaksolla
+      replayPeriod(game->period);
+      startPlayerTimer(player);
+    }
+  }
+  if (result == GAME_SPEEDUP) {
+    if (playerCount > 1) {
+      scoreMessage("Tilanne ");
+    }
+    else {
+      display.gameMessage(game->score);
+    }
+    eyesOfSpede();
+    setGameState(2);
   }
 }
 
@@ -117,36 +586,92 @@ void initializeGame()
 	Serial.println("Pelin aloitusta");
   // see requirements for the function from SpedenSpelit.h
   // ledit nollaan
-  initButtonsAndButtonInterrupts(&buttonPress, &startButton);
+  if (replayPlaying()) {
+    // toistossa painallukset tulevat tallennuksesta
+    gameSeed = replaySeed();
+    playerCount = 1;
+    if (attractMode) {
+      // esittelyssä napit vain keskeyttävät
+      initButtonsAndButtonInterrupts(&attractButton, &startButton);
+    }
+    else {
+      disableButtonInterrupts();
+    }
+  }
+  else {
+    gameSeed = settings.seed != 0 ? settings.seed : micros();
+    playerCount = settings.players == 2 ? 2 : 1;
+    attractMode = false;
+    initButtonsAndButtonInterrupts(&buttonPress, &startButton);
+  }
+  timerCancel(&attractTimer);
+  randomSeed(gameSeed);
   clearAllLeds();
   // display tyhjennys
-  // listojen nollaus
-  timer = 1000000;
-  for (int i = 0; i < 10; i++) {
-    painetut_numerot[i] = 0;
-    random_numerot[i] = 0;
-  }
-  //muuttujien nollaus
-  laskin = 0;
-  randNumber = 0;;
-  score = 0;
-  index = 0;
-  gameState = 4;
+  // listojen ja muuttujien nollaus, jakso alkuun (1 s), toistossa käyrä tulee tallennuksesta
+  uint8_t curve = replayPlaying() ? replayCurve() : settings.curve;
+  if (curve >= sizeof(gameCurves) / sizeof(gameCurves[0])) {
+    curve = 0;
+  }
+  // napit jaetaan pelaajille tasan, yksinpelissä kaikki ensimmäiselle
+  uint8_t share = buttonCount / playerCount;
+  for (uint8_t i = 0; i < 2; i++) {
+    Player *player = &players[i];
+    timerCancel(&player->timer);
+    gameReset(&player->game, gameCurves[curve]);
+    player->firstButton = i * share;
+    player->buttons = i == playerCount - 1 ? buttonCount - player->firstButton : share;
+    player->ledGroup = (((uint32_t)1 << player->buttons) - 1) << player->firstButton; // 16 napilla yli intin
+    player->lastEvent = millis();
+  }
+  setGameState(4);
+  if (playerCount > 1) {
+    // kaksinpelin tickit lomittuvat, niitä ei voi toistaa yhdestä tallennuksesta
+    replayAbort();
+  }
+  else {
+    replayBegin(gameSeed, players[0].game.period, curve);
+  }
   initializeTimer();
-  display.clearSSeg();
-  display.gameMessage(score);
-  Timer1.resume();
+  if (playerCount > 1) {
+    display.writeScores(0, 0);
+    display.writeToLCD("Kaksinpeli, kumpi kestää?");
+  }
+  else {
+    display.clearSSeg();
+    display.gameMessage(0);
+  }
 }
 
-void lostTheGame() {
-  Timer1.stop();
+void lostTheGame(Player *player) {
+  for (uint8_t i = 0; i < playerCount; i++) {
+    timerCancel(&players[i].timer);
+  }
   disableButtonInterrupts();
   clearAllLeds();
   startButtonLed(1);
   Serial.println("Peli menetetty");
-  gameState = 1;
+  setGameState(1);
+  bool playedBack = replayPlaying(); // toistettu tai esittelypeli ei mene ennätyksiin
+  replayEnd(players[0].game.score);
+  taskWake(&replayTask); // tallennuksen tulostus ja EEPROM hoidetaan taskissa
+  if (playerCount == 1 && !playedBack) {
+    uint8_t place = settingsAddScore(players[0].game.score);
+    if (place > 0) {
+      Serial.print("Ennätyslistalle sijalle ");
+      Serial.println(place);
+    }
+  }
+  attractMode = false;
+  timerStart(&attractTimer, attractDelay, 0); // esittely taas kun kukaan ei ala pelata
 
-  display.writeToLCD("Koitit ison etkäsaa penniäkään!");
+  if (playerCount > 1) {
+    // kaksinpelissä ensimmäisenä virheen tehnyt häviää
+    scoreMessage(player == &players[0] ? "Pelaaja 2 voitti! " : "Pelaaja 1 voitti! ");
+  }
+  else {
+    display.writeToLCD("Koitit ison etkäsaa penniäkään!");
+  }
 }
 
 void startTheGame()
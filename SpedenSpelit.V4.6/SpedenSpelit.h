@@ -3,8 +3,9 @@
 #include <arduino.h>
 
 /*
-  initializeTimer() subroutine intializes Arduino Timer1 module to
-  give interrupts at rate 1Hz
+  initializeTimer() subroutine (re)starts the game tick of every
+  player, a periodic software timer on the Timer1 timer wheel
+  (timers.h), at the player's current speed (1Hz at the start)
   
 */
 void initializeTimer(void);
@@ -40,4 +41,4 @@ void checkGame(byte);
 void startTheGame(void);
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
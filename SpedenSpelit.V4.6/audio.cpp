@@ -1,158 +1,444 @@
 #include "pitches.h"
+#include "leds.h"
+#include "timers.h"
+#include "board.h"
 
-const int buzzerPin = 5;//pin will change in final version
+/*
+  The melodies are played by a sequencer that runs in the Timer2 compare interrupt at a fixed sample rate.
+  Every sample the voice's phase accumulator is advanced and its top bit is written to the buzzer (a square wave),
+  and every note lasts an exact number of samples, so the timing doesn't depend on how long loop() takes.
+  16 MHz / 8 (prescaler) / 128 (OCR2A + 1) = 15625 samples per second
+*/
+#define SAMPLE_RATE 15625
 
-void gameStateDetect(int gameState) {
-  //int gameState = 0;
-  static bool effectStart = true;
-  static unsigned long effectStartTime = 0;
-  if (gameState != 1 && gameState != 2)
-  {
-    effectStart = true;
+/*
+  Three voices play at the same time: music, effects (win/fail) and the button click. All of them keep time in the
+  interrupt, but the buzzer is a single pin, so only the voice whose melody has the highest priority is heard. The others
+  run muted underneath and come back in the right place when it stops.
+  A request for a busy voice pre-empts the melody on it if its priority is at least as high, otherwise it's queued (one slot)
+  and starts when the current melody ends.
+*/
+#define VOICE_COUNT 3
+
+/*
+  A tempo synced melody (the background music) takes its tempo from the game: a whole note lasts exactly one game tick.
+  Its note lengths are worked out from the tick period instead of the sample rate, so they cost nothing extra, and every
+  Timer1 tick calls musicTick(), which starts the next whole-note beat. A voice that finishes its beat early sustains its
+  last note until the tick, one that is late skips to the next beat, so the music can't drift away from the LEDs.
+*/
+
+struct Voice {
+  const Melody *melody;
+  const Melody *queued;
+  const uint8_t *notes;
+  uint8_t length;
+  uint8_t note;
+  bool loop;
+  bool queuedLoop;
+  // Length of a whole note in samples and the current note's length code (whole = 0)
+  uint16_t wholeSamples;
+  uint8_t noteCode;
+  // Tempo sync: sixteenths of the beat already played, and whether the beat is done and waiting for the tick
+  uint8_t beatUnits;
+  bool waitingForBeat;
+  uint16_t samplesLeft;
+  uint16_t phase;
+  uint16_t phaseStep;
+};
+
+/*
+  The Timer2 sample tick is shared with the led animations (leds.cpp). The interrupt runs while any user needs it
+*/
+volatile uint8_t fastTickUsers = 0;
+
+volatile Voice voices[VOICE_COUNT];
+// The voice that drives the buzzer, -1 when everything is quiet
+volatile int8_t outputVoice = -1;
+// Whole note length of synced melodies, follows the game tick period
+volatile uint16_t syncedWholeSamples = SAMPLE_RATE;
+
+/*
+  Melodies are stored in flash as two bytes per note: the pitch's position in PITCH_LIST (pitches.h) and the note length
+  as a power of two (0 = whole note, 1 = half ... 4 = sixteenth). The bytes are worked out by the compiler from the
+  NOTE_ constants, and a melody with a pitch or length that doesn't exist fails the build.
+  Playing a note then only needs a table lookup, the melody is never copied out of flash
+*/
+#define AS_FREQUENCY(pitch) pitch,
+#define AS_PHASE_STEP(pitch) (uint16_t)(((uint32_t)(pitch) * 65536UL + SAMPLE_RATE / 2) / SAMPLE_RATE),
+
+constexpr int pitchFrequencies[] = { PITCH_LIST(AS_FREQUENCY) };
+const uint8_t pitchCount = sizeof(pitchFrequencies) / sizeof(int);
+
+// Phase step of each pitch at the sample rate, the interrupt reads these instead of multiplying
+const uint16_t phaseSteps[] PROGMEM = { PITCH_LIST(AS_PHASE_STEP) };
+
+// 0xFF marks a pitch or length that can't be stored
+constexpr uint8_t pitchIndex(int frequency, uint8_t i = 0) {
+  return i >= pitchCount ? 0xFF : (pitchFrequencies[i] == frequency ? i : pitchIndex(frequency, i + 1));
+}
+
+constexpr uint8_t durationCode(int duration) {
+  return duration == 1 ? 0 : duration == 2 ? 1 : duration == 4 ? 2 : duration == 8 ? 3 : duration == 16 ? 4 : 0xFF;
+}
+
+// Checks every note of a melody, used in the static_asserts below
+constexpr bool notesValid(const uint8_t notes[], uint16_t size, uint16_t i = 0) {
+  return i >= size ? true : (notes[i] != 0xFF && notes[i + 1] != 0xFF && notesValid(notes, size, i + 2));
+}
+
+#define NOTE(pitch, duration) pitchIndex(pitch), durationCode(duration)
+
+constexpr uint8_t winNotes[] PROGMEM = {
+  NOTE(NOTE_C4, 8), NOTE(NOTE_E4, 8), NOTE(NOTE_C5, 8)
+};
+
+constexpr uint8_t failNotes[] PROGMEM = {
+  NOTE(NOTE_C3, 8), NOTE(NOTE_G2, 8), NOTE(NOTE_C3, 2)
+};
+
+// The last two lengths were missing from the original duration array
+constexpr uint8_t startNotes[] PROGMEM = {
+  NOTE(NOTE_B5, 8), NOTE(NOTE_B5, 16), NOTE(NOTE_C6, 8), NOTE(NOTE_B5, 16), NOTE(NOTE_B5, 4), NOTE(NOTE_E5, 4),
+  NOTE(NOTE_E5, 4), NOTE(NOTE_E5, 4), NOTE(NOTE_FS5, 4), NOTE(NOTE_G5, 4), NOTE(NOTE_B5, 4), NOTE(NOTE_A5, 4),
+  NOTE(NOTE_B5, 4), NOTE(NOTE_A5, 4), NOTE(NOTE_G5, 4), NOTE(NOTE_G5, 4), NOTE(NOTE_FS5, 4), NOTE(NOTE_G5, 4),
+  NOTE(NOTE_A5, 4), NOTE(NOTE_C6, 4), NOTE(NOTE_B5, 2), NOTE(NOTE_A5, 1), NOTE(NOTE_G5, 4), NOTE(NOTE_G5, 2)
+};
+
+constexpr uint8_t backgroundNotes[] PROGMEM = {
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+
+  NOTE(NOTE_G3, 8), NOTE(NOTE_D3, 8), NOTE(NOTE_G3, 8), NOTE(NOTE_C4, 8),
+  NOTE(NOTE_G3, 8), NOTE(NOTE_D3, 8), NOTE(NOTE_G3, 8), NOTE(NOTE_C4, 8),
+  NOTE(NOTE_G3, 8), NOTE(NOTE_D3, 8), NOTE(NOTE_G3, 8), NOTE(NOTE_C4, 8),
+  NOTE(NOTE_G3, 8), NOTE(NOTE_D3, 8), NOTE(NOTE_G3, 8), NOTE(NOTE_C4, 8),
+
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+  NOTE(NOTE_A3, 8), NOTE(NOTE_E3, 8), NOTE(NOTE_A3, 8), NOTE(NOTE_D4, 8),
+
+  NOTE(NOTE_F3, 8), NOTE(NOTE_C3, 8), NOTE(NOTE_F3, 8), NOTE(NOTE_A3, 8),
+  NOTE(NOTE_F3, 8), NOTE(NOTE_C3, 8), NOTE(NOTE_F3, 8), NOTE(NOTE_A3, 8),
+  NOTE(NOTE_F3, 8), NOTE(NOTE_C3, 8), NOTE(NOTE_F3, 8), NOTE(NOTE_A3, 8),
+  NOTE(NOTE_F3, 8), NOTE(NOTE_C3, 8), NOTE(NOTE_F3, 8), NOTE(NOTE_A3, 8),
+
+  NOTE(NOTE_F3, 2), NOTE(NOTE_C2, 2), NOTE(NOTE_F2, 1)
+};
+
+constexpr uint8_t buttonNotes[] PROGMEM = {
+  NOTE(NOTE_C5, 8)
+};
+
+#define MELODY(notes, priority, tempoSynced) { notes, sizeof(notes) / 2, priority, tempoSynced }; \
+  static_assert(sizeof(notes) / 2 <= 255, #notes " is too long"); \
+  static_assert(notesValid(notes, sizeof(notes)), #notes " has a pitch or length that doesn't exist")
+
+const Melody winMelody = MELODY(winNotes, PRIORITY_WIN, false);
+const Melody failMelody = MELODY(failNotes, PRIORITY_FAIL, false);
+const Melody startMelody = MELODY(startNotes, PRIORITY_MUSIC, false);
+const Melody backgroundMelody = MELODY(backgroundNotes, PRIORITY_MUSIC, true);
+const Melody buttonMelody = MELODY(buttonNotes, PRIORITY_CLICK, false);
+
+/*
+  Sets Timer2 to count up to OCR2A and restart (CTC mode), the compare interrupt is only enabled while something is playing
+*/
+void initializeAudio(void) {
+  FastPin<buzzerPin>::output();
+  FastPin<buzzerPin>::low();
+
+  for (uint8_t i = 0; i < VOICE_COUNT; i++) {
+    voices[i].melody = 0;
+    voices[i].queued = 0;
   }
-  if (gameState == 1) {
-    if (effectStart == true) {
-      effectStart = false;
-      effectStartTime = millis();
+  outputVoice = -1;
+
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS21);
+  OCR2A = (F_CPU / 8 / SAMPLE_RATE) - 1;
+  if (fastTickUsers == 0) {
+    TIMSK2 &= ~_BV(OCIE2A);
+  }
+}
+
+/*
+  Loads the voice's current note. Called from the interrupt, takes the same time whatever the note
+*/
+static void loadNote(volatile Voice &voice) {
+  const uint8_t *note = voice.notes + 2 * voice.note;
+  voice.phaseStep = pgm_read_word(&phaseSteps[pgm_read_byte(note)]);
+  voice.noteCode = pgm_read_byte(note + 1);
+  voice.samplesLeft = voice.wholeSamples >> voice.noteCode;
+}
+
+/*
+  Hands the buzzer to the highest priority voice that is playing (ties go to the later voice) and turns the interrupt off
+  when nothing is. Only runs when a melody starts or stops, never per sample. Call with interrupts disabled
+*/
+static void selectOutput() {
+  int8_t selected = -1;
+  for (uint8_t i = 0; i < VOICE_COUNT; i++) {
+    if (voices[i].melody != 0 && (selected < 0 || voices[i].melody->priority >= voices[selected].melody->priority)) {
+      selected = i;
+    }
+  }
+  outputVoice = selected;
+
+  if (selected < 0) {
+    FastPin<buzzerPin>::low();
+  }
+  fastTickEnable(FASTTICK_AUDIO, selected >= 0);
+}
+
+void fastTickEnable(uint8_t user, bool enable) {
+  uint8_t oldSREG = SREG;
+  cli();
+  if (enable) {
+    if (fastTickUsers == 0) {
+      TCNT2 = 0;
+      TIMSK2 |= _BV(OCIE2A);
+    }
+    fastTickUsers |= user;
+  }
+  else {
+    fastTickUsers &= ~user;
+    if (fastTickUsers == 0) {
+      TIMSK2 &= ~_BV(OCIE2A);
+    }
+  }
+  SREG = oldSREG;
+}
+
+// Call with interrupts disabled
+static void startVoice(volatile Voice &voice, const Melody *melody, bool loop) {
+  voice.melody = melody;
+  voice.queued = 0;
+  voice.notes = melody->notes;
+  voice.length = melody->length;
+  voice.loop = loop;
+  voice.note = 0;
+  voice.phase = 0;
+  voice.beatUnits = 0;
+  if (melody->tempoSynced) {
+    voice.wholeSamples = syncedWholeSamples;
+    // A synced melody starts on the next tick
+    voice.waitingForBeat = true;
+  }
+  else {
+    voice.wholeSamples = SAMPLE_RATE;
+    voice.waitingForBeat = false;
+  }
+  loadNote(voice);
+  selectOutput();
+}
+
+/*
+  Moves the voice to its next note, looping or ending the melody as needed. Call with interrupts disabled
+*/
+static void nextNote(volatile Voice &voice) {
+  voice.note++;
+  if (voice.note < voice.length) {
+    loadNote(voice);
+  }
+  else if (voice.loop) {
+    voice.note = 0;
+    loadNote(voice);
+  }
+  else if (voice.queued != 0) {
+    startVoice(voice, voice.queued, voice.queuedLoop);
+  }
+  else {
+    // Melody over, let a muted voice take over or stop the interrupt
+    voice.melody = 0;
+    selectOutput();
+  }
+}
+
+ISR(TIMER2_COMPA_vect) {
+  if (fastTickUsers & FASTTICK_LEDS) {
+    ledTick();
+  }
+  if (!(fastTickUsers & FASTTICK_AUDIO)) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < VOICE_COUNT; i++) {
+    volatile Voice &voice = voices[i];
+    if (voice.melody == 0) {
+      continue;
+    }
+    voice.phase += voice.phaseStep;
+
+    if (voice.waitingForBeat) {
+      continue;
     }
-    if (millis() - effectStartTime < 750) {
-      failEffect();
+    if (--voice.samplesLeft == 0) {
+      if (voice.melody->tempoSynced) {
+        voice.beatUnits += 16 >> voice.noteCode;
+        if (voice.beatUnits >= 16) {
+          // Beat done before the tick, hold the note until musicTick()
+          voice.waitingForBeat = true;
+          continue;
+        }
+      }
+      nextNote(voice);
     }
-    else if (millis() - effectStartTime < 2000) {
-      //
+  }
+
+  if (outputVoice >= 0) {
+    volatile Voice &voice = voices[outputVoice];
+    if (voice.phaseStep != 0 && (voice.phase & 0x8000)) {
+      FastPin<buzzerPin>::high();
     }
     else {
-      gameState = 0;
+      FastPin<buzzerPin>::low();
     }
   }
-  if (gameState == 0) {
+}
+
+/*
+  The win and fail effects last a fixed time, a one-shot timer ends them instead of the loop checking the clock
+*/
+static void effectOver();
+SoftTimer effectTimer = { &effectOver, TIMER_ISR };
+volatile int effectState;
+
+static void effectOver() {
+  if (effectState == 1) {
+    // Game over jingle and a short pause done, back to the start screen music
+    startMusic();
+  }
+  else {
+    stopMelody(VOICE_EFFECT);
+  }
+}
+
+/*
+  Called whenever the game state changes
+  0 = start screen, 1 = game lost, 2 = level up, 4 = playing
+*/
+void gameStateDetect(int gameState) {
+  effectState = gameState;
+  if (gameState == 1) {
+    // The fail effect is a one-shot that lasts 750 ms, the start music comes back after 2 s
+    stopMelody(VOICE_MUSIC);
+    failEffect();
+    timerStart(&effectTimer, 2000, 0);
+  }
+  else if (gameState == 0) {
+    timerCancel(&effectTimer);
     startMusic();
   }
   else if (gameState == 2) {
-    if (effectStart == true) {
-      effectStart = false;
-      effectStartTime = millis();
+    // The music keeps going muted under the win effect so it stays on the beat
+    backgroundMusic();
+    winEffect();
+    timerStart(&effectTimer, 1500, 0);
+  }
+  else if (gameState == 4) {
+    timerCancel(&effectTimer);
+    backgroundMusic();
+    stopMelody(VOICE_EFFECT);
+  }
+}
+
+/*
+  Called on every game tick with the tick period (microseconds). Sets the tempo of synced melodies and starts their next beat
+*/
+void musicTick(long period) {
+  uint8_t oldSREG = SREG;
+  cli();
+  // SAMPLE_RATE / 1000000 = 1 / 64
+  syncedWholeSamples = period >> 6;
+
+  for (uint8_t i = 0; i < VOICE_COUNT; i++) {
+    volatile Voice &voice = voices[i];
+    if (voice.melody == 0 || !voice.melody->tempoSynced) {
+      continue;
     }
-    if (millis() - effectStartTime < 1500) {
-      winEffect();
+    voice.wholeSamples = syncedWholeSamples;
+
+    if (voice.waitingForBeat) {
+      voice.waitingForBeat = false;
+      // The first beat of the melody starts with the note already loaded
+      if (voice.beatUnits >= 16) {
+        nextNote(voice);
+      }
+      else {
+        voice.samplesLeft = voice.wholeSamples >> voice.noteCode;
+      }
     }
+    else {
+      // Behind the tick (the tempo went up mid-beat), skip what's left of the beat
+      while (voice.melody != 0 && voice.beatUnits < 16) {
+        voice.beatUnits += 16 >> voice.noteCode;
+        nextNote(voice);
+      }
+    }
+    voice.beatUnits = 0;
   }
+  SREG = oldSREG;
 }
 
-void playMelody(const int melody[], const int noteDurations[], int melodyLength) {
-  //Serial.println("playMelody");
-  static int thisNote = 0;
-  static unsigned long noteStartTime = 0;
-  int noteDuration = 1000 / noteDurations[thisNote];
+/*
+  Starts the melody on the given voice from its first note. If the voice is busy with a higher priority melody the new one
+  is queued instead. Nothing happens if the melody is already playing (the state functions call this every loop)
+*/
+void playMelody(const Melody *melody, uint8_t voiceNumber, bool loop) {
+  volatile Voice &voice = voices[voiceNumber];
+  if (voice.melody == melody) {
+    return;
+  }
 
-  if (millis() - noteStartTime >= noteDuration) {
-    tone(buzzerPin, melody[thisNote], noteDuration);
-    noteStartTime = millis();
-    thisNote++;
+  uint8_t oldSREG = SREG;
+  cli();
+  if (voice.melody == 0 || melody->priority >= voice.melody->priority) {
+    startVoice(voice, melody, loop);
   }
-  else if (thisNote > melodyLength - 1){
-    thisNote = 0;
+  else {
+    voice.queued = melody;
+    voice.queuedLoop = loop;
   }
+  SREG = oldSREG;
 }
 
-void winEffect() {
-  int melody[] = {
-    //melody has the pitches we want the function to play
-    NOTE_C4, NOTE_E4, NOTE_C5
-  };
+void stopMelody(uint8_t voiceNumber) {
+  volatile Voice &voice = voices[voiceNumber];
+  if (voice.melody == 0 && voice.queued == 0) {
+    return;
+  }
 
-  int noteDurations[] = {
-    //note durations for each pitch presented in melody
-    8, 8, 8
-  };
+  uint8_t oldSREG = SREG;
+  cli();
+  voice.melody = 0;
+  voice.queued = 0;
+  selectOutput();
+  SREG = oldSREG;
+}
 
-  playMelody(melody, noteDurations, 3);
-  //call to the function playMelody
-  //3 is the number of pitches used in this melody
+void winEffect() {
+  playMelody(&winMelody, VOICE_EFFECT, true);
 }
 
 void failEffect() {
   //Serial.print("failEf");
-  int melody[] = {
-    NOTE_C3, NOTE_G2, NOTE_C3
-  };
-
-  int noteDurations[] = {
-    8, 8, 2
-  };
-
-  playMelody(melody, noteDurations, 3);
+  playMelody(&failMelody, VOICE_EFFECT, false);
 }
 
 void startMusic() {
-  int melody[] = {
-    NOTE_B5, NOTE_B5, NOTE_C6, NOTE_B5, NOTE_B5, NOTE_E5, NOTE_E5, NOTE_E5, NOTE_FS5, NOTE_G5, NOTE_B5, NOTE_A5, NOTE_B5, NOTE_A5, NOTE_G5, NOTE_G5, NOTE_FS5, NOTE_G5, NOTE_A5, NOTE_C6, NOTE_B5, NOTE_A5, NOTE_G5, NOTE_G5};
-  int noteDurations[] = {8, 16, 8, 16, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 2, 1};
-  playMelody(melody, noteDurations, 24);
+  playMelody(&startMelody, VOICE_MUSIC, true);
 }
 
 void backgroundMusic() {
-  int melody[] = {
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    
-    NOTE_G3, NOTE_D3, NOTE_G3, NOTE_C4,
-    NOTE_G3, NOTE_D3, NOTE_G3, NOTE_C4,
-    NOTE_G3, NOTE_D3, NOTE_G3, NOTE_C4,
-    NOTE_G3, NOTE_D3, NOTE_G3, NOTE_C4,
-
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    NOTE_A3, NOTE_E3, NOTE_A3, NOTE_D4,
-    
-    NOTE_F3, NOTE_C3, NOTE_F3, NOTE_A3,
-    NOTE_F3, NOTE_C3, NOTE_F3, NOTE_A3,
-    NOTE_F3, NOTE_C3, NOTE_F3, NOTE_A3,
-    NOTE_F3, NOTE_C3, NOTE_F3, NOTE_A3,
-
-    NOTE_F3, NOTE_C2, NOTE_F2
-  };
-
-  int noteDurations[] = {
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-    8, 8, 8, 8,
-
-    2, 2, 1,
-  };
-
-  playMelody(melody, noteDurations, 67);
+  playMelody(&backgroundMelody, VOICE_MUSIC, true);
 }
 
+// Every press restarts the click from its first note, playMelody() would leave a click that is still playing alone
 void buttonSound() {
-  int melody[] = {
-    //melody has the pitches we want the function to play
-    NOTE_C5
-  };
-
-  int noteDurations[] = {
-    //note durations for each pitch presented in melody
-    8
-  };
-
-  playMelody(melody, noteDurations, 1);
+  uint8_t oldSREG = SREG;
+  cli();
+  startVoice(voices[VOICE_CLICK], &buttonMelody, false);
+  SREG = oldSREG;
 }
@@ -0,0 +1,166 @@
+/*
+Every pin the game uses, in one place. Moving something to another pin is a change to this file only, and the checks at the
+bottom stop the build if two things end up on the same pin or a module's wiring assumptions no longer hold.
+
+The pins are compile-time constants, so FastPin<pin> can turn each access into a single instruction (sbi/cbi for one bit,
+in/out for reads) instead of digitalWrite()'s table lookups and checks. Arduino Uno / ATmega328 only:
+  pins 0-7 = PORTD bits 0-7, pins 8-13 = PORTB bits 0-5, pins A0-A5 (14-19) = PORTC bits 0-5
+
+HOW TO USE:
+  FastPin<buzzerPin>::output();  FastPin<buzzerPin>::high();  if (FastPin<startButtonPin>::read()) ...
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+#include <arduino.h>
+
+// Serial-to-parallel chain of the displays (display.h)
+constexpr uint8_t stpSerialPin = 2;
+constexpr uint8_t stpSerialClockPin = 3;
+constexpr uint8_t stpRegisterClockPin = 4;
+constexpr uint8_t stpSerialClearPin = 7;
+constexpr uint8_t stpOutputEnablePin = 8;
+
+// Buzzer (audio.cpp)
+constexpr uint8_t buzzerPin = 5;
+
+// Leds (leds.cpp). The eyes are dimmed by Timer0's hardware PWM, so they have to be on its output A
+constexpr uint8_t ledPin0 = A2;
+constexpr uint8_t ledPin1 = A3;
+constexpr uint8_t ledPin2 = A4;
+constexpr uint8_t ledPin3 = A5;
+constexpr uint8_t eyeLedPin = 6;
+constexpr uint8_t startLedPin = A0;
+
+/*
+Buttons (buttons.cpp). The game sees them as numbers 0 to buttonCount - 1, and the targets, leds and replays follow that.
+Two ways to wire them:
+  BUTTONS_PINS   each button on its own PORTB pin, read through pin change interrupt 0 (up to 4 game buttons + start)
+  BUTTONS_SHIFT  a chain of 74HC165 parallel-load shift registers read in one SPI burst every buttonScanPeriod ms.
+                 Game button n goes to input n % 8 (A = 0 ... H = 7) of chip n / 8, where chip 0 is the one whose QH goes
+                 to MISO (pin 12), and the start button goes to the input after the last game button. CLK goes to SCK
+                 (pin 13), SH/LD to buttonLoadPin and CLK INH to ground
+*/
+#define BUTTONS_PINS 0
+#define BUTTONS_SHIFT 1
+#define BUTTON_INPUT BUTTONS_PINS
+
+constexpr uint8_t buttonCount = 4;
+
+#if BUTTON_INPUT == BUTTONS_PINS
+constexpr uint8_t firstButtonPin = 9;
+constexpr uint8_t lastButtonPin = firstButtonPin + buttonCount - 1;
+constexpr uint8_t startButtonPin = 13;
+#else
+constexpr uint8_t buttonLoadPin = 10;
+constexpr uint8_t buttonMisoPin = 12;
+constexpr uint8_t buttonClockPin = 13;
+// Bytes read per scan, one per chip: the game buttons and the start button
+constexpr uint8_t buttonChainLength = (buttonCount + 1 + 7) / 8;
+constexpr uint8_t buttonScanPeriod = 2;
+#endif
+
+/*
+Button leds (leds.cpp). Buttons 0-3 have the PORTC game leds above, the leds of buttons 4 and up are on a chain of 74HC595s
+that shares the display chain's serial and serial clock pins and has a latch pin of its own. The led of button n goes to
+output (n - 4) % 8 (QA = 0 ... QH = 7) of chip (n - 4) / 8, where chip 0 is the one whose SER is on stpSerialPin. SRCLR
+is tied high and OE to ground. Neither chain latches what the other one shifts through it, and both write with
+interrupts off, so they can share the pins
+*/
+constexpr uint8_t gameLedCount = 4;
+constexpr uint8_t extraLedCount = buttonCount > gameLedCount ? buttonCount - gameLedCount : 0;
+constexpr uint8_t extraLedChainLength = (extraLedCount + 7) / 8;
+constexpr uint8_t extraLedLatchPin = A1;
+
+/*
+Single instruction access to a pin known at compile time. Every function is a chain of ifs on the pin, which the compiler
+folds down to the one port access that's left
+*/
+template <uint8_t pin>
+struct FastPin {
+  static_assert(pin < 20, "the Uno only has pins 0-19");
+  static const uint8_t mask = 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+
+  static void output() {
+    if (pin < 8) DDRD |= mask;
+    else if (pin < 14) DDRB |= mask;
+    else DDRC |= mask;
+  }
+
+  static void inputPullup() {
+    if (pin < 8) { DDRD &= ~mask; PORTD |= mask; }
+    else if (pin < 14) { DDRB &= ~mask; PORTB |= mask; }
+    else { DDRC &= ~mask; PORTC |= mask; }
+  }
+
+  static void high() {
+    if (pin < 8) PORTD |= mask;
+    else if (pin < 14) PORTB |= mask;
+    else PORTC |= mask;
+  }
+
+  static void low() {
+    if (pin < 8) PORTD &= ~mask;
+    else if (pin < 14) PORTB &= ~mask;
+    else PORTC &= ~mask;
+  }
+
+  static void write(bool state) {
+    if (state) high();
+    else low();
+  }
+
+  // Writing a one to the PIN register flips the output
+  static void toggle() {
+    if (pin < 8) PIND = mask;
+    else if (pin < 14) PINB = mask;
+    else PINC = mask;
+  }
+
+  static bool read() {
+    if (pin < 8) return PIND & mask;
+    else if (pin < 14) return PINB & mask;
+    else return PINC & mask;
+  }
+};
+
+/*
+Compile-time checks of the pin assignment
+*/
+constexpr uint32_t pinBit(uint8_t pin) {
+  return (uint32_t)1 << pin;
+}
+
+constexpr uint8_t bitCount(uint32_t bits) {
+  return bits == 0 ? 0 : (bits & 1) + bitCount(bits >> 1);
+}
+
+#if BUTTON_INPUT == BUTTONS_PINS
+constexpr uint32_t buttonPins = (pinBit(lastButtonPin + 1) - pinBit(firstButtonPin)) | pinBit(startButtonPin);
+constexpr uint8_t buttonPinCount = buttonCount + 1;
+#else
+constexpr uint32_t buttonPins = pinBit(buttonLoadPin) | pinBit(buttonMisoPin) | pinBit(buttonClockPin);
+constexpr uint8_t buttonPinCount = 3;
+#endif
+
+// Every pin in use, the button range included
+constexpr uint32_t usedPins =
+  pinBit(stpSerialPin) | pinBit(stpSerialClockPin) | pinBit(stpRegisterClockPin) | pinBit(stpSerialClearPin) |
+  pinBit(stpOutputEnablePin) | pinBit(buzzerPin) | pinBit(ledPin0) | pinBit(ledPin1) | pinBit(ledPin2) | pinBit(ledPin3) |
+  pinBit(eyeLedPin) | pinBit(startLedPin) | buttonPins | (extraLedCount > 0 ? pinBit(extraLedLatchPin) : 0);
+constexpr uint8_t usedPinCount = 12 + buttonPinCount + (extraLedCount > 0 ? 1 : 0);
+
+static_assert(bitCount(usedPins) == usedPinCount, "two things are wired to the same pin");
+static_assert((usedPins & (pinBit(0) | pinBit(1))) == 0, "pins 0 and 1 belong to Serial");
+static_assert(eyeLedPin == 6, "eye leds must be on pin 6 (OC0A)");
+static_assert(buttonCount >= 2 && buttonCount <= 16, "the game needs 2-16 buttons (replays keep button numbers in 4 bits)");
+#if BUTTON_INPUT == BUTTONS_PINS
+static_assert(firstButtonPin >= 8 && lastButtonPin <= 13 && startButtonPin >= 8 && startButtonPin <= 13,
+  "buttons must be on PORTB (pins 8-13), pin change interrupt 0 only covers those");
+#else
+static_assert(buttonMisoPin == 12 && buttonClockPin == 13, "the 74HC165 chain is read with the hardware SPI (MISO 12, SCK 13)");
+static_assert(buttonLoadPin == 10, "SS (pin 10) has to be an output for the SPI to stay master, so it drives SH/LD");
+static_assert(buttonChainLength <= 4, "a scan holds at most 32 inputs");
+#endif
+
+#endif
@@ -1,73 +1,227 @@
 #include "buttons.h"
+#include "scheduler.h"
+#include "timers.h"
+#include "board.h"
+#include "latency.h"
 
-volatile bool ISRactivated = 0;
+static void buttonsActivated(void);
+static uint8_t buttonTaskRun(Task *task);
 
-const byte firstPin = 9; // first PinChangeInterrupt on D-bus
-const byte lastPin =  12; // last PinChangeInterrupt on D-bus
-const byte startButton = 13; //start button seperately for clarity
+//the pin change interrupt (or the chain scan) wakes this task, the buttons are read once they've had 5 ms to settle
+Task buttonTask = { &buttonTaskRun };
+volatile bool pinChanged = false;
+const uint16_t settleTime = 5;
 
-void (*interruptFunction)(int); //pointer for pins (int is for pin number)
-void (*startButtonInterruptFunction)(); //pointer for pin 7 (start button)
+void (*interruptFunction)(int); //pointer for game buttons (int is the button number, 0 to buttonCount - 1)
+void (*startButtonInterruptFunction)(); //pointer for the start button
+uint16_t debounceInterval = 100; //any additional transitions during this time are ignored to prevent false button presses
 
-void initButtonsAndButtonInterrupts(void (*function)(int), void (*startFunction)()) {
-  //fuction address for "function" which calls game button interrupts and "startFunction" for calling the start button interrupt
-    for (byte pin = firstPin; pin <= lastPin; ++pin) { //D-bus defines buttons as...buttons (INPUT_PULLUP)
-        pinMode(pin, INPUT_PULLUP);
+#if BUTTON_INPUT == BUTTONS_PINS
+//the pins are in board.h, all buttons are on PORTB so one read of PINB gets them all
+const byte buttonBits = ((1 << buttonCount) - 1) << (firstButtonPin - 8); //bits of the game buttons
+const byte startButtonBit = FastPin<startButtonPin>::mask; //start button seperately for clarity
+
+static void setupInputs(void) {
+    byte oldSREG = SREG; //PORTB is shared with the display pins, so the read-modify-writes can't be interrupted
+    cli();
+    DDRB &= ~(buttonBits | startButtonBit); //D-bus defines buttons as...buttons (INPUT_PULLUP)
+    PORTB |= buttonBits | startButtonBit; //pullups for the game buttons and the start button
+    SREG = oldSREG;
+
+    //interrupts for pins
+    PCICR |= (1 << PCIE0);
+    PCMSK0 |= buttonBits | startButtonBit; //PCINT0-5 are the same bits as PORTB0-5
+}
+
+static void disableGameButtons(void) {
+    PCMSK0 &= ~buttonBits;
+}
+
+//pressed game buttons (bit n = button n) and the start button, a pressed button reads low
+static uint16_t readButtons(bool &start) {
+    byte pins = PINB; //all buttons at once
+    start = (pins & startButtonBit) == 0;
+    return (byte)(~pins & buttonBits) >> (firstButtonPin - 8);
+}
+
+ISR(PCINT0_vect) {
+    //the latency test mode (latency.h) measures from the moment a game button goes down
+    static byte previousPins = 0xFF;
+    byte pins = PINB;
+    if (~pins & previousPins & buttonBits) {
+        latencyEdge();
+    }
+    previousPins = pins;
+
+    pinChanged = true;
+    taskWake(&buttonTask);
+}
+
+#else
+//the 74HC165 chain is read in one SPI burst by a timer every buttonScanPeriod ms, a change wakes the task like a pin
+//change interrupt would
+static void scanChain(void);
+SoftTimer scanTimer = { &scanChain, TIMER_ISR };
+volatile uint32_t chainState = 0; //bit n = input n of the chain, 1 = pressed
+volatile bool gameButtonsEnabled = false;
+const uint32_t gameButtonMask = ((uint32_t)1 << buttonCount) - 1;
+const uint32_t startInputBit = (uint32_t)1 << buttonCount;
+
+//loads the inputs into the chips and shifts length bytes out of them, chip 0 first
+static uint32_t readChain(uint8_t length) {
+    FastPin<buttonLoadPin>::low(); //SH/LD low copies the inputs into the shift registers
+    FastPin<buttonLoadPin>::high();
+    uint32_t inputs = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        SPDR = 0;
+        while ((SPSR & (1 << SPIF)) == 0);
+        inputs |= (uint32_t)SPDR << (8 * i);
+    }
+    return ~inputs; //the inputs have pullups, a press pulls one low
+}
+
+static void setupSpi(void) {
+    FastPin<buttonLoadPin>::output();
+    FastPin<buttonLoadPin>::high();
+    FastPin<buttonClockPin>::output();
+    //SPI master, mode 0, MSB first (input H comes out first), 16 MHz / 2
+    SPCR = (1 << SPE) | (1 << MSTR);
+    SPSR = (1 << SPI2X);
+}
+
+static void setupInputs(void) {
+    setupSpi();
+    byte oldSREG = SREG;
+    cli();
+    chainState = readChain(buttonChainLength) & (gameButtonMask | startInputBit);
+    gameButtonsEnabled = true;
+    SREG = oldSREG;
+    timerStart(&scanTimer, buttonScanPeriod, buttonScanPeriod);
+}
+
+static void disableGameButtons(void) {
+    gameButtonsEnabled = false;
+}
+
+static uint16_t readButtons(bool &start) {
+    byte oldSREG = SREG; //the scan writes the state from its interrupt, four bytes can't be read in one go
+    cli();
+    uint32_t state = chainState;
+    SREG = oldSREG;
+    start = (state & startInputBit) != 0;
+    return state & gameButtonMask;
+}
+
+//runs from the timer wheel interrupt
+static void scanChain(void) {
+    uint32_t inputs = readChain(buttonChainLength) & (gameButtonMask | startInputBit);
+    uint32_t watched = startInputBit | (gameButtonsEnabled ? gameButtonMask : 0);
+    if (inputs & ~chainState & gameButtonMask & watched) {
+        latencyEdge();
     }
-    pinMode(startButton, INPUT_PULLUP); //pinmode for start button
+    uint32_t changed = (inputs ^ chainState) & watched;
+    chainState = inputs;
+    if (changed != 0) {
+        pinChanged = true;
+        taskWake(&buttonTask);
+    }
+}
+#endif
 
+void initButtonsAndButtonInterrupts(void (*function)(int), void (*startFunction)()) {
+  //fuction address for "function" which calls game button interrupts and "startFunction" for calling the start button interrupt
     interruptFunction = function;
     startButtonInterruptFunction = startFunction;
-    
-    //interrupts for pins
-    PCICR |= (1 << PCIE0);
-    PCMSK0 |= (1 << PCINT1) | (1 << PCINT2) | (1 << PCINT3) | (1 << PCINT4) | (1 << PCINT5);
 
-    ISRactivated = false;
+    setupInputs();
+
+    pinChanged = false;
+    taskAdd(&buttonTask, PRIORITY_BUTTONS);
 
     sei();
 }
 
+void setButtonDebounce(uint16_t ms) {
+  debounceInterval = ms;
+}
+
 void disableButtonInterrupts(void) { //function for disabling button interrupts when called
-    //disables interrupts for pins (game buttons)
-    PCMSK0 &= ~((1 << PCINT1) | (1 << PCINT2) | (1 << PCINT3) | (1 << PCINT4));
-    //optionally, you can disable the entire PCIE2 if needed if you want to also disable pin (start button)
-    //PCICR &= ~(1 << PCIE2);
+    //disables interrupts for the game buttons, the start button still works
+    disableGameButtons();
 }
 
-void buttonsActivated(void) {
-  if (ISRactivated == false) {
-    return;
-  }
-  
-  delay(5);
-  
+static void buttonsActivated(void) {
   //debounce prevents false button presses
   static unsigned long lastInterruptTime = 0;
   unsigned long currentTime = millis(); //stores time in milliseconds
-  unsigned long debounceInterval = 100; //any additional transitions duting this time are ignored to prevent false button presses
-  //adjust if needed
+  //debounceInterval is adjusted with setButtonDebounce()
 
   /*Serial.print(lastInterruptTime);
   Serial.print(", ");
   Serial.println(currentTime);*/
   
     if (currentTime - lastInterruptTime > debounceInterval) { //checks if enough time has passed since last button press
-        for (byte pin = firstPin; pin <= lastPin; pin++) { //D-bus for detecting low state in pins
-            if (digitalRead(pin) == LOW) { //this part reads which button has been pressed when grounded
-                interruptFunction(pin); //calling function
+        bool start;
+        uint16_t pressed = readButtons(start); //all buttons at once
+        for (byte button = 0; button < buttonCount; button++) { //D-bus for detecting pressed buttons
+            if (pressed & (1 << button)) { //this part reads which button has been pressed when grounded
+                interruptFunction(button); //calling function
             }
         }
-        if (digitalRead(startButton) == LOW) {
+        if (start) {
             startButtonInterruptFunction(); //calling function
         }
 
         lastInterruptTime = currentTime;
     }
-  
-  ISRactivated = false;
 }
 
-ISR(PCINT0_vect) {
-    ISRactivated = true;
+static uint8_t buttonTaskRun(Task *task) {
+  PT_BEGIN(task);
+  for (;;) {
+    PT_WAIT_UNTIL(task, pinChanged);
+    //more edges while the pins settle don't restart the wait
+    PT_SLEEP(task, settleTime);
+    pinChanged = false;
+    buttonsActivated();
+  }
+  PT_END(task);
+}
+
+void buttonBenchmark(void) {
+  #if BUTTONBENCHFLAG == 1
+  const unsigned long rounds = 1000;
+  #if BUTTON_INPUT == BUTTONS_PINS
+  bool start;
+  volatile uint16_t sink;
+  unsigned long begin = micros();
+  for (unsigned long i = 0; i < rounds; i++) {
+    sink = readButtons(start);
+  }
+  Serial.print("Button scan, PINB: ");
+  Serial.print((micros() - begin) / (rounds / 1000.0));
+  Serial.println(" ns");
+  #else
+  //the chain doesn't have to be that long for the timing, extra bytes just read the last chip's serial input
+  //the scan timer's interrupt uses the same SPI and latch, so it's held off until the timing is done
+  bool scanning = timerActive(&scanTimer);
+  timerCancel(&scanTimer);
+  setupSpi();
+  for (uint8_t length = 1; length <= 4; length++) {
+    unsigned long begin = micros();
+    for (unsigned long i = 0; i < rounds; i++) {
+      readChain(length);
+    }
+    unsigned long spent = micros() - begin;
+    Serial.print("Button scan, ");
+    Serial.print(length * 8);
+    Serial.print(" inputs: ");
+    Serial.print(spent / (rounds / 1000.0));
+    Serial.println(" ns");
+  }
+  if (scanning) {
+    timerStart(&scanTimer, buttonScanPeriod, buttonScanPeriod);
+  }
+  #endif
+  #endif
 }
\ No newline at end of file
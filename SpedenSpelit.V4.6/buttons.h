@@ -2,15 +2,29 @@
 #define BUTTONS_H
 #include <arduino.h>
 
-void buttonsActivated(void);
+// Set to 1 to time one button scan once at startup (results over Serial), with BUTTONS_SHIFT for chains of 8-32 inputs
+#define BUTTONBENCHFLAG 0
 
 void initButtonsAndButtonInterrupts(void (*function)(int), void (*startFunction)());
 /*function is for the game buttons. It takes one parameter which
- is a pointer to a function
+ is a pointer to a function, the function gets the button number
+ 0 to buttonCount - 1 (board.h, where the input wiring is chosen too)
  startFunction is a pointer only for the start button
+ the functions are called from the button task (scheduler.h) once
+ the pressed pin has settled, so schedulerRun() has to be in the loop
 */
 void disableButtonInterrupts(void);
-/*this function disables button interrupts from pins 2-5 (game buttons)
+/*this function disables button interrupts from the game buttons
+ */
+void setButtonDebounce(uint16_t ms);
+/*sets how long further presses are ignored after one (ms), the
+ default is 100. A settings value (settings.h), so it can be
+ tuned for the buttons of the box without a new build
+ */
+void buttonBenchmark(void);
+/*times the button scan when BUTTONBENCHFLAG is 1. Can be called
+ after initButtonsAndButtonInterrupts(), the chain scan is held
+ off while it runs (a press in those few ms can be missed)
  */
 
 
@@ -0,0 +1,109 @@
+#include "console.h"
+
+char lineBuffer[CONSOLE_LINE + 1];
+uint8_t lineLength = 0;
+bool lineTooLong = false;
+bool lineReady = false;
+unsigned long lastByteTime = 0;
+const char *wordStarts[CONSOLE_WORDS];
+uint8_t wordCount = 0;
+
+/*
+Cuts the line into words by writing a zero after each one
+*/
+static void splitLine() {
+  wordCount = 0;
+  if (lineTooLong) {
+    return;
+  }
+  lineBuffer[lineLength] = 0;
+  bool inWord = false;
+  for (uint8_t i = 0; i < lineLength; i++) {
+    if (lineBuffer[i] == ' ' || lineBuffer[i] == '\t') {
+      lineBuffer[i] = 0;
+      inWord = false;
+    }
+    else if (!inWord) {
+      inWord = true;
+      if (wordCount < CONSOLE_WORDS) {
+        wordStarts[wordCount++] = &lineBuffer[i];
+      }
+    }
+  }
+}
+
+static void endLine() {
+  splitLine();
+  lineReady = true;
+}
+
+bool consoleRead(void) {
+  if (lineReady) {
+    return true;
+  }
+  while (Serial.available() > 0) {
+    char data = Serial.read();
+    lastByteTime = millis();
+    if (data == '\r' || data == '\n') {
+      // "\r\n" gives an empty line after the real one, it's skipped
+      if (lineLength > 0 || lineTooLong) {
+        endLine();
+        return true;
+      }
+      continue;
+    }
+    if (lineLength < CONSOLE_LINE) {
+      lineBuffer[lineLength++] = data;
+    }
+    else {
+      lineTooLong = true;
+    }
+  }
+  if ((lineLength > 0 || lineTooLong) && millis() - lastByteTime >= CONSOLE_IDLE_MS) {
+    endLine();
+    return true;
+  }
+  return false;
+}
+
+void consoleDone(void) {
+  lineLength = 0;
+  lineTooLong = false;
+  lineReady = false;
+  wordCount = 0;
+}
+
+uint8_t consoleWords(void) {
+  return wordCount;
+}
+
+const char *consoleWord(uint8_t index) {
+  if (index >= wordCount) {
+    return "";
+  }
+  return wordStarts[index];
+}
+
+bool consoleIs(uint8_t index, const char *text) {
+  return strcmp(consoleWord(index), text) == 0;
+}
+
+bool consoleNumber(uint8_t index, uint32_t *value) {
+  const char *word = consoleWord(index);
+  if (*word == 0) {
+    return false;
+  }
+  uint32_t number = 0;
+  for (; *word != 0; word++) {
+    if (*word < '0' || *word > '9') {
+      return false;
+    }
+    uint8_t digit = *word - '0';
+    if (number > (0xFFFFFFFFUL - digit) / 10) {
+      return false;
+    }
+    number = number * 10 + digit;
+  }
+  *value = number;
+  return true;
+}
@@ -0,0 +1,45 @@
+/*
+Line-based command console on the Serial port. The UART's receive interrupt (HardwareSerial) already collects the bytes,
+consoleRead() moves whatever has arrived into a fixed line buffer and returns at once, so nothing ever waits for the
+sender. When a line is complete it's split into words in place, one pass over the line.
+
+A line ends at '\r' or '\n', or when nothing more has arrived for CONSOLE_IDLE_MS (the Serial Monitor's "No line ending"
+setting). Words are separated by spaces, a line longer than the buffer is dropped whole.
+
+HOW TO USE:
+  1. Call consoleRead() regularly (e.g. from a task every 20 ms). It returns true when a line is waiting
+  2. consoleWords() tells how many words it has, consoleIs() and consoleNumber() look at them
+  3. consoleDone() frees the buffer for the next line
+*/
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+#include <arduino.h>
+
+// Longest line in bytes and most words kept from one line
+#define CONSOLE_LINE 32
+#define CONSOLE_WORDS 4
+#define CONSOLE_IDLE_MS 100
+
+/*
+Takes what has arrived on Serial. Returns true when a complete line is waiting (until consoleDone())
+*/
+bool consoleRead(void);
+
+void consoleDone(void);
+
+// Number of words in the waiting line, 0 if it was empty or too long
+uint8_t consoleWords(void);
+
+// The word at index (0 = the command), "" past the last one
+const char *consoleWord(uint8_t index);
+
+// True if the word at index is text
+bool consoleIs(uint8_t index, const char *text);
+
+/*
+Reads the word at index as a decimal number. Returns false if it isn't one or doesn't fit in 32 bits
+*/
+bool consoleNumber(uint8_t index, uint32_t *value);
+
+#endif
@@ -10,18 +10,25 @@ v5 - 18.12.2023 - Jenna Salmela
 */
 
 #include "display.h"
+#include "board.h"
+
+// The StP control pins are compile-time constants (board.h), so every pin change below is a single instruction
+typedef FastPin<stpSerialPin> serialPin;
+typedef FastPin<stpSerialClockPin> serialClockPin;
+typedef FastPin<stpRegisterClockPin> registerClockPin;
+typedef FastPin<stpSerialClearPin> serialClearPin;
+typedef FastPin<stpOutputEnablePin> outputEnablePin;
 
 /*
 Display setup - make sure to call during setup
-Parameters: 
-  The board locations/pin numbers of the five pins that are used for StP control.
+The five pins that are used for StP control are set in board.h:
     1. Serial (data line)
     2. Serial clock (output that moves a bit from serial input to serial registers)
     3. Register clock (output that moves data from the serial registers to output registers)
     4. Serial clear (clears the serial registers' contents)
     5. Output enable (enables or disables the output of output registers' contents)
 */
-int Display::initializeDisplays(uint8_t ser, uint8_t serClock, uint8_t regClock, uint8_t serClear, uint8_t opEnable) {
+int Display::initializeDisplays() {
   
   #if DEBUGFLAG == 1
   Serial.println("Initializing displays");
@@ -38,27 +45,19 @@ int Display::initializeDisplays(uint8_t ser, uint8_t serClock, uint8_t regClock,
     currentMessage[k] = 0;
   }
   
-  // Pin prep
-  // Take given pin number data, assign to be used by the program
-  serial = ser;
-  serialClock = serClock;
-  registerClock = regClock;
-  serialClear = serClear;
-  outputEnable = opEnable;
-  
   // Prep StP control pins
-  pinMode(serial, OUTPUT);  
-  pinMode(serialClock, OUTPUT);
-  pinMode(registerClock, OUTPUT);
-  pinMode(serialClear, OUTPUT);
-  pinMode(outputEnable, OUTPUT);
+  serialPin::output();
+  serialClockPin::output();
+  registerClockPin::output();
+  serialClearPin::output();
+  outputEnablePin::output();
 
   // Prep pin states
-  digitalWrite(serial, LOW);
-  digitalWrite(serialClock, LOW);
-  digitalWrite(registerClock, LOW);
-  digitalWrite(serialClear, HIGH);
-  digitalWrite(outputEnable, LOW);
+  serialPin::low();
+  serialClockPin::low();
+  registerClockPin::low();
+  serialClearPin::high();
+  outputEnablePin::low();
 
   // 7-segment prep
   if (segmentDisplayAmount > 0) {
@@ -87,6 +86,7 @@ int Display::clearSSeg() {
   Serial.println("Clearing 7-segment");
   #endif
   writeToSSeg(0);
+  return 0;
 }
 
 /*
@@ -119,7 +119,43 @@ int Display::writeToSSeg(uint16_t score) {
   }
 
   scoreToDigits(digits);
-  updateDisplays();
+  commitSegments();
+
+  return 0;
+}
+
+/*
+Shows two scores on the halves of the 7-segment displays. Each half is filled from its last digit backwards and stops when
+the score runs out, so a zero score still shows a 0 but no leading zeroes
+Parameters:
+  left, right = the scores of the left and right half
+*/
+int Display::writeScores(uint16_t left, uint16_t right) {
+  #if DEBUGFLAG == 1
+  Serial.println("Writing two scores to 7-segment");
+  #endif
+
+  const uint8_t half = segmentDisplayAmount / 2;
+  uint8_t digits[segmentDisplayAmount];
+  for (int i = 0; i < segmentDisplayAmount; i++) {
+    digits[i] = blankDigit;
+  }
+  uint16_t scores[2] = { left, right };
+  for (int side = 0; side < 2; side++) {
+    int last = side == 0 ? half - 1 : segmentDisplayAmount - 1;
+    uint16_t score = scores[side];
+    for (int i = 0; i < half; i++) {
+      digits[last - i] = score % 10;
+      score /= 10;
+      if (score == 0) {
+        break;
+      }
+    }
+  }
+
+  // Every digit is already as it should be shown, no leading zeroes to hide
+  scoreToDigits(digits, false);
+  commitSegments();
 
   return 0;
 }
@@ -193,6 +229,7 @@ int Display::gameMessage(int score) {
       currentMessage[i] |= (1 << 7);
     }
   }
+  return 0;
 }
 
 /*
@@ -203,58 +240,73 @@ int Display::writeToLCD(char message[]) {
   #if DEBUGFLAG == 1
   Serial.println("Writing to LCD");
   #endif
-  
+
+  // The message is converted into a buffer of its own with interrupts on, the LCD may still be writing the previous one
   // The display's in-built character database luckily corresponds quite closely to standard ASCII, so for most
   // letters you can just take the char and paste it onto the message array to be passed to the display
   // There are a few inaccuracies with non-alphabet characters (like \ to yen), but I can't be arsed to look into those right now
+  uint8_t converted[maxMessageLength];
+  uint8_t length = 0;
   int i = 0;
   int j = 0;
-  messageLength = 0;
   while (message[j] != '\0' && (i < maxMessageLength)) {
     if (15 < i && i < 40) {
-      currentMessage[i] = 32;
-      messageLength++;
+      converted[i] = 32;
+      length++;
       i++;
       continue;
     }
     if (31 < message[j] && message[j] < 128) {
-      currentMessage[i] = message[j];
+      converted[i] = message[j];
     }
     // Here you could add support for some of the extra characters available on the display
     else {
       switch (message[j]) {
         // ä (only lower case will ever be printed)
         case -61:
-          currentMessage[i] = 0b11100001;
+          converted[i] = 0b11100001;
           j++;
           break;
         // maybe ö, not tested
         case 148:
-          currentMessage[i] = 0b11101111;
+          converted[i] = 0b11101111;
           j++;
           break;
         default:
           // space
-          currentMessage[i] = 32;
+          converted[i] = 32;
           break;
       }
     }
-    messageLength++;
+    length++;
     i++;
     j++;
   }
   // Fill the rest of the array with zeroes
   for (; i < maxMessageLength; i++) {
-    currentMessage[i] = 0;
+    converted[i] = 0;
+  }
+
+  // A new message replaces the whole screen. The clear goes in first and drops the writes still in the queue, so the
+  // buffer can be swapped without an older write picking the new message up halfway. Messages can come from interrupts
+  // too, so only the hand-off to the queue is done with interrupts off (the clear, a 50 byte copy and the write)
+  uint8_t oldSREG = SREG;
+  cli();
+  lcdQueueManager(clear, 1);
+  messageVersion++;
+  for (int k = 0; k < maxMessageLength; k++) {
+    currentMessage[k] = converted[k];
   }
+  messageLength = length;
 
   // Let the queue manager know that it should write characters starting from 0
   messageProgress = 0;
-  // First move the cursor to the corner of the screen
-  lcdQueueManager(clear, 1);
-  lcdQueueManager(clrCsr);
+  messageStartTime = micros();
+  // The clear above also moves the cursor to the corner (a separate return home would only add 1.5 ms)
   // Then start writing the message
   lcdQueueManager(write, 2);
+  SREG = oldSREG;
+  return 0;
 }
 
 /*
@@ -266,24 +318,62 @@ int Display::clearLCD() {
   Serial.println("Clearing LCD");
   #endif
   lcdQueueManager(clear);
+  return 0;
 }
 
 /*
-Calls the LCD queue execution function if there's anything left to do
+Calls the LCD queue execution function for every instruction the LCD is ready for
+Short waits (character writes) are waited out here so a message goes out in one burst, a long one (clear) is left for the
+next call so the caller can do something else meanwhile
 */
 void Display::lcdInterruptCheck() {
   if (lcdDisplayAmount < 1) {
     return;
   }
 
-  if (lcdInterruptActive) {
+  unsigned long start = micros();
+  while (lcdInterruptActive) {
+    uint16_t wait = lcdWaitTime();
+    if (wait > 0) {
+      if (wait > lcdSpinTime || micros() - start + wait > lcdBurstTime) {
+        return;
+      }
+      delayMicroseconds(wait);
+    }
     #if DEBUGFLAG == 1
     Serial.println("Redirecting to LCD instruction queue manager");
     #endif
     lcdQueueInterrupt();
-  } 
+    if (micros() - start >= lcdBurstTime) {
+      return;
+    }
+  }
 }
 
+/*
+Microseconds left until the LCD is done with the last instruction
+*/
+uint16_t Display::lcdWaitTime() {
+  long wait = lcdReadyTime - micros();
+  if (wait <= 0) {
+    return 0;
+  }
+  return wait;
+}
+
+/*
+How long the last message took to get onto the screen
+*/
+unsigned long Display::lcdMessageTime() {
+  return messageTime;
+}
+
+/*
+Saves the function that's called when the LCD queue gets work
+*/
+void Display::setLcdWakeFunction(void (*function)()) {
+  lcdWakeFunction = function;
+}
 
 /********************************************************/
 // Below code intended for internal use
@@ -296,42 +386,159 @@ int Display::updateDisplays() {
   Serial.println("Writing data to StPs");
   #endif
 
+  // Scores can be written from interrupts too, so one pass through the chain goes out whole. This is the only part of
+  // an LCD instruction that keeps interrupts off (40 bits, about 38 us)
+  uint8_t oldSREG = SREG;
+  cli();
+
   // Allow serial registers to take in/retain data
-  digitalWrite(serialClear, HIGH);
+  serialClearPin::high();
   
-  // Variable to hold the next 1 or 0 to be passed to the registers
-  uint8_t bit;
   // Registers are pushed in "butt-first"
   for (int j = stpTotal; j > 0; j--) {
+    // Starting from LSB, the register is shifted down a bit at a time (a variable shift is a loop of its own on the AVR)
+    uint8_t data = registers[j - 1];
     for (int i = 0; i < 8; i++) {
-      // Starting from LSB, take each bit of the register
-      bit = ((registers[j - 1] & (1 << i)) >> i);
       // Pass the serial output
-      if (bit == 1) {
-        digitalWrite(serial, HIGH);
+      if (data & 1) {
+        serialPin::high();
       }
       else {
-        digitalWrite(serial, LOW);
+        serialPin::low();
       }
-      //Serial.print(bit);
+      data >>= 1;
       // And activate the serial clock pulse to make the serial register(s) take that bit in
-      digitalWrite(serialClock, HIGH);
-      digitalWrite(serialClock, LOW);
+      serialClockPin::high();
+      serialClockPin::low();
     }
   }
 
   // Give the signal to pass serial data to display registers
-  digitalWrite(registerClock, HIGH);
-  digitalWrite(registerClock, LOW);
+  registerClockPin::high();
+  registerClockPin::low();
 
+  SREG = oldSREG;
   return 0;
 }
 
+/*
+Without rolling the new segments go out at once. With it, a digit that changed starts from the digit it was heading to,
+so a score that changes again mid-roll just turns the roll towards the newest value
+*/
+int Display::commitSegments() {
+  #if SSEGROLLFLAG == 1
+  if (sSegFrameFunction != 0) {
+    bool wasRolling = false;
+    bool changed = false;
+    for (int i = 0; i < segmentDisplayAmount; i++) {
+      if (rollFrames[i] != 0) {
+        wasRolling = true;
+      }
+      if (registers[i] != rollTarget[i]) {
+        rollFrom[i] = rollTarget[i];
+        rollTarget[i] = registers[i];
+        rollFrames[i] = 1;
+        changed = true;
+      }
+      // The current frame stays out until the next one is due, the LCD also sends these registers
+      registers[i] = rollShown[i];
+    }
+    if (changed && !wasRolling) {
+      sSegFrameFunction();
+    }
+    return 0;
+  }
+  #endif
+
+  for (int i = 0; i < segmentDisplayAmount; i++) {
+    rollTarget[i] = registers[i];
+    rollShown[i] = registers[i];
+    rollFrames[i] = 0;
+  }
+  updateDisplays();
+  return 0;
+}
+
+void Display::setSSegFrameFunction(void (*function)()) {
+  sSegFrameFunction = function;
+}
+
+bool Display::sSegRolls() {
+  #if SSEGROLLFLAG == 1
+  return sSegFrameFunction != 0;
+  #else
+  return false;
+  #endif
+}
+
+/*
+Frame 1 is the old digit halfway out through the top, frame 2 the new one halfway in from the bottom, and the last frame
+the new digit. Only the 7-segment registers change, the LCD's go out again as they were (its enable stays low, so the LCD
+ignores them)
+*/
+bool Display::sSegFrame() {
+  bool rolling = false;
+  for (int i = 0; i < segmentDisplayAmount; i++) {
+    if (rollFrames[i] == 0) {
+      continue;
+    }
+    if (rollFrames[i] == 1) {
+      rollShown[i] = rollUp(rollFrom[i]);
+    }
+    else if (rollFrames[i] == 2) {
+      rollShown[i] = rollDown(rollTarget[i]);
+    }
+    else {
+      rollShown[i] = rollTarget[i];
+    }
+    registers[i] = rollShown[i];
+
+    if (rollFrames[i] < rollFrameCount) {
+      rollFrames[i]++;
+      rolling = true;
+    }
+    else {
+      rollFrames[i] = 0;
+    }
+  }
+  updateDisplays();
+  return rolling;
+}
+
+// Segment bits of a 7-seg register, see the register structure in display.h
+#define SEG_A 0b10000000
+#define SEG_B 0b01000000
+#define SEG_C 0b00100000
+#define SEG_D 0b00010000
+#define SEG_E 0b00001000
+#define SEG_F 0b00000100
+#define SEG_G 0b00000010
+
+uint8_t Display::rollUp(uint8_t segments) {
+  // The lower half moves up: G to A, E and C to F and B, D to G
+  uint8_t result = 0;
+  if (segments & SEG_G) result |= SEG_A;
+  if (segments & SEG_E) result |= SEG_F;
+  if (segments & SEG_C) result |= SEG_B;
+  if (segments & SEG_D) result |= SEG_G;
+  return result;
+}
+
+uint8_t Display::rollDown(uint8_t segments) {
+  // The upper half moves down: A to G, F and B to E and C, G to D
+  uint8_t result = 0;
+  if (segments & SEG_A) result |= SEG_G;
+  if (segments & SEG_F) result |= SEG_E;
+  if (segments & SEG_B) result |= SEG_C;
+  if (segments & SEG_G) result |= SEG_D;
+  return result;
+}
+
 /*
 Converts a set of digits into the bits required to display that number on a 7-segment display, plus saves said bits into
 the system's 7-segment-displays' registers
 */
-int Display::scoreToDigits(uint8_t digits[]) {
+int Display::scoreToDigits(uint8_t digits[], bool hideLeadingZeroes) {
   #if DEBUGFLAG == 1
   Serial.println("Converting score to digits");
   #endif  
@@ -340,7 +547,7 @@ int Display::scoreToDigits(uint8_t digits[]) {
   int leadingZeroes = 0;
   // Checks all the digits from most significant number(?) to second-to-last, ticking up the leading zero counter for as long as 
   // zeroes come up
-  for (int j = 0; j < segmentDisplayAmount - 1; j++) {
+  for (int j = 0; j < segmentDisplayAmount - 1 && hideLeadingZeroes; j++) {
     if (digits[j] == 0) {
       leadingZeroes++;
     }
@@ -387,6 +594,9 @@ int Display::scoreToDigits(uint8_t digits[]) {
     case 9:
       registers[i] = 0b11110110;
       break;
+    case blankDigit:
+      registers[i] = 0b00000000;
+      break;
     default:
       return 1;
       break;
@@ -404,22 +614,47 @@ int Display::initializeLCD() {
   Serial.println("Initalizing LCD");
   #endif
 
-  // The 4 steps of setting up the display's settings:
+  // The 4 steps of setting up the display's settings, in the datasheet's order (function set has to come first):
+  // Data bus to 8-bit, 2 lines on the display, text font 5x8 pixels
+  lcdQueueManager(dataSet, 1);
+  // Display on, no visible cursor, no cursor blink
+  lcdQueueManager(displaySet, 1);
   // Clearing the screen
   lcdQueueManager(clear, 1);
   // Setting the cursor movement direction to left & screen movement off
-  lcdQueueManager(moveSet);
-  // Display on, no visible cursor, no cursor blink
-  lcdQueueManager(displaySet);
-  // Data bus to 8-bit, 2 lines on the display, text font 5x8 pixels
-  lcdQueueManager(dataSet, 2);
+  lcdQueueManager(moveSet, 2);
+  return 0;
+}
+
+/*
+Execution times of the instructions from the HD44780 datasheet (at a 270 kHz oscillator), times 1.5 so that a display
+whose oscillator runs as slow as 180 kHz still keeps up
+*/
+uint16_t Display::instructionTime(uint8_t instruction) {
+  switch (instruction) {
+    // Clear and return home 1.52 ms
+    case clear:
+    case clrCsr:
+      return 1520 * 3 / 2;
+    // Writing a character 37 us + 4 us to update the address counter
+    case write:
+      return 41 * 3 / 2;
+    // Entry mode, display control and function set 37 us
+    default:
+      return 37 * 3 / 2;
+  }
 }
 
 /*
 Executes instructions from the LCD's instruction queue one at a time. Rerouted to from the game's loop function
 */
 int Display::lcdQueueInterrupt() {  
+  // The queue can also be added to from interrupts, so it's read and moved on with interrupts off. The instruction goes out
+  // to the LCD after that with them on, only each of its chain writes is atomic (updateDisplays())
+  uint8_t oldSREG = SREG;
   cli();
+  uint8_t instruction = lcdInstructionQueue[0];
+  bool abandoned = false;
   #if DEBUGFLAG == 1
   Serial.print("In the LCD instruction queue: ");
   for (int i = 0; i < 10; i++) {
@@ -429,7 +664,7 @@ int Display::lcdQueueInterrupt() {
   Serial.println();
   #endif
 
-  switch (lcdInstructionQueue[0]) {
+  switch (instruction) {
   // End of queue, pause interrupts and take note
   case pause:
     #if DEBUGFLAG == 1
@@ -445,7 +680,6 @@ int Display::lcdQueueInterrupt() {
     // Enter the instruction to wipe the screen
     registers[segmentDisplayAmount] = 0;
     registers[segmentDisplayAmount + 1] = (1 << 1);
-    pulseLCDEnable();
     break;
   // Display movement settings
   case moveSet:
@@ -455,7 +689,6 @@ int Display::lcdQueueInterrupt() {
     // Cursor moves right, screen says put between inputs
     registers[segmentDisplayAmount] = 0;
     registers[segmentDisplayAmount + 1] = (1 << 2) | (1 << 3);
-    pulseLCDEnable();
     break;
   // Adjusts display [display rather than movement] settings
   case displaySet:
@@ -465,7 +698,6 @@ int Display::lcdQueueInterrupt() {
     // Screen on, no cursor, no cursor blink
     registers[segmentDisplayAmount] = 0;
     registers[segmentDisplayAmount + 1] = (1 << 3) | (1 << 4);
-    pulseLCDEnable();
     break;
   // Define data bus as 8-bit, display with two rows and font as 5x8
   case dataSet:
@@ -474,39 +706,60 @@ int Display::lcdQueueInterrupt() {
     #endif
     registers[segmentDisplayAmount] = 0;
     registers[segmentDisplayAmount + 1] = (1 << 4) | (1 << 5) | (1 << 6);
-    pulseLCDEnable();
     break;
   // Write out a character of a message on screen
   case write:
     #if DEBUGFLAG == 1
     Serial.println("LCD write activates");
     #endif
+    // A write keeps to the message it started with
+    if (messageProgress == 0) {
+      writeVersion = messageVersion;
+    }
+    else if (writeVersion != messageVersion) {
+      queueStats.versionAborts++;
+      abandoned = true;
+      break;
+    }
     // Set data writing bit to 1 and push character data onto the correct ouput slots
     registers[segmentDisplayAmount] = ((1 << 4) | ((currentMessage[messageProgress] & (1 << 7)) >> 7) << 1);
     registers[segmentDisplayAmount + 1] = (currentMessage[messageProgress] << 1);
     messageProgress++;
-    pulseLCDEnable();
     break; 
   // This command moves both the cursor and data address back to 0
   case clrCsr:
     #if DEBUGFLAG == 1
     Serial.println("LCD cursor clear activated");
     #endif
+    // Return home is 0b00000010
     registers[segmentDisplayAmount] = 0;
-    registers[segmentDisplayAmount + 1] = (1 << 1);
+    registers[segmentDisplayAmount + 1] = (1 << 2);
     break;
   }
 
+  bool send = instruction != pause && !abandoned;
+  bool lastCharacter = instruction == write && messageProgress >= messageLength;
+
   // If the process of printing a message is still ongoing, don't advance the queue
-  if (lcdInstructionQueue[0] == 5 && messageProgress < messageLength) {
-    return 0;
+  if (!(instruction == write && messageProgress < messageLength && !abandoned)) {
+    // Shift the instruction queue ahead by one step
+    for (int i = 0; i < (lcdQueueSize - 1); i++) {
+      lcdInstructionQueue[i] = lcdInstructionQueue[i + 1];
+    }
+    lcdInstructionQueue[lcdQueueSize - 1] = 0;
   }
-  // Shift the instruction queue ahead by one step
-  for (int i = 0; i < (lcdQueueSize - 1); i++) {
-    lcdInstructionQueue[i] = lcdInstructionQueue[i + 1];
+  SREG = oldSREG;
+
+  if (send) {
+    pulseLCDEnable();
+    // The next instruction has to wait until the LCD has executed this one
+    lcdReadyTime = micros() + instructionTime(instruction);
+    if (lastCharacter) {
+      // The last character is on the screen once the LCD has executed it
+      messageTime = lcdReadyTime - messageStartTime;
+    }
   }
-  lcdInstructionQueue[lcdQueueSize - 1] = 0;
-  sei();
+  return 0;
 }
 
 /*
@@ -527,6 +780,35 @@ int Display::lcdQueueManager(int instructionNo, int holdBackInterrupt = 0) {
   Serial.println("Writing to LCD instruction queue");
   #endif
 
+  // Called from interrupts as well as the LCD task's side, the queue must not change halfway through
+  uint8_t oldSREG = SREG;
+  cli();
+
+  // A clear wipes the screen, so the writes, clears and returns home still waiting before it would be wasted. Settings
+  // instructions stay in their order. A write that is halfway done is dropped too, the clear removes what it wrote
+  if (instructionNo == clear) {
+    uint8_t kept = 0;
+    for (int i = 0; i < lcdQueueSize && lcdInstructionQueue[i] != pause; i++) {
+      uint8_t instruction = lcdInstructionQueue[i];
+      if (instruction == write) {
+        queueStats.writesCancelled++;
+        queueStats.charactersSkipped += (i == 0) ? messageLength - messageProgress : messageLength;
+      }
+      else if (instruction == clear) {
+        queueStats.clearsMerged++;
+      }
+      else if (instruction == clrCsr) {
+        queueStats.homesMerged++;
+      }
+      else {
+        lcdInstructionQueue[kept++] = instruction;
+      }
+    }
+    for (int i = kept; i < lcdQueueSize; i++) {
+      lcdInstructionQueue[i] = pause;
+    }
+  }
+
   // Run down the queue until you find the first 0 (empty instruction slot)
   int queueNo;
   //Serial.print("In the instruction queue, line no. ");
@@ -536,9 +818,6 @@ int Display::lcdQueueManager(int instructionNo, int holdBackInterrupt = 0) {
   for (int i = 0; i < lcdQueueSize; i++) {
     queueNo = i;
     
-    // Here could be inserted some sort of check that removes existing write operations if a clear command comes in
-    //if (instructionNo == 1 && lcdInstructionQueue[i] == 5)
-    
     #if DEBUGFLAG == 1
     Serial.print(lcdInstructionQueue[i]);
     Serial.print(", ");
@@ -553,17 +832,42 @@ int Display::lcdQueueManager(int instructionNo, int holdBackInterrupt = 0) {
   Serial.println();
   #endif
 
+  // A return home right after a clear or another return home does nothing the LCD hasn't already done
+  if (instructionNo == clrCsr && queueNo > 0 &&
+      (lcdInstructionQueue[queueNo - 1] == clear || lcdInstructionQueue[queueNo - 1] == clrCsr)) {
+    queueStats.homesMerged++;
+    SREG = oldSREG;
+    return 0;
+  }
+
   // Operations are differentiated by instruction numbers in the LCD interrupt manager
   lcdInstructionQueue[queueNo] = instructionNo;
 
   // If there is nothing else awaiting execution, call the interrupt manager directly (otherwise let the
   // interrupt program run on timer)
   if (holdBackInterrupt == 1) {
-    return;
+    SREG = oldSREG;
+    return 0;
   }
   else if (queueNo == 0 || holdBackInterrupt == 2) {
     lcdInterruptActive = true;
+    if (lcdWakeFunction != 0) {
+      lcdWakeFunction();
+    }
   }
+  SREG = oldSREG;
+  return 0;
+}
+
+/*
+Copy of the compaction counters
+*/
+Display::LcdQueueStats Display::lcdQueueStats() {
+  uint8_t oldSREG = SREG;
+  cli();
+  LcdQueueStats copy = queueStats;
+  SREG = oldSREG;
+  return copy;
 }
 
 /*
@@ -582,4 +886,5 @@ int Display::pulseLCDEnable() {
   updateDisplays();
   registers[segmentDisplayAmount] &= 0b11111011;
   updateDisplays();
+  return 0;
 }
@@ -15,10 +15,13 @@ HOW TO USE:
     if you have more or fewer displays
   2. Set the DEBUGFLAG to 1 to get Serial.prints from each activating function, or to 0 to not
   3. Create a "Display [object name]" object 
-  4. Call [object name].initializeDisplays();, give function five pins connected to an StP port
+  4. Set the five pins connected to the StP port in board.h, then call [object name].initializeDisplays();
   5. Place [object name].lcdInterruptCheck(); to the loop function (or some other constantly repeating section of code) - this writes to the
-    LCD screen and instruction at a time. Can be skipped if no LCDs are attached.
+    LCD screen and instruction at a time. Can be skipped if no LCDs are attached. With a scheduler, setLcdWakeFunction() tells
+    when there's something to write.
   6. Use [object name].writeToSSeg(), [object name].writeToLCD() and other public functions to control the attached displays.
+  7. Set the SSEGROLLFLAG to 1 to roll changed 7-segment digits to their new value instead of jumping. Give setSSegFrameFunction()
+    a function that starts a timer, and call [object name].sSegFrame() from that timer until it returns false.
 */
 
 #ifndef DISPLAY_H
@@ -26,19 +29,20 @@ HOW TO USE:
 #include <arduino.h>
 
 #define DEBUGFLAG 0
+#define SSEGROLLFLAG 1
 
 class Display {
   public:
     /*
     Display setup - make sure to call during setup
-    Parameters: the board locations/pin numbers of the five pins that are used for StP control.
+    The five pins that are used for StP control come from board.h:
       1. Serial (data line)
       2. Serial clock (output that moves a bit from serial input to serial registers)
       3. Register clock (output that moves data from the serial registers to output registers)
       4. Serial clear (clears the serial registers' contents)
       5. Output enable (enables or disables the output of output registers' contents)
     */
-    int initializeDisplays(uint8_t ser, uint8_t serClock, uint8_t regClock, uint8_t serClear, uint8_t opEnable);
+    int initializeDisplays();
 
     /*
     Writes the number 0 to the 7-segment display
@@ -56,6 +60,13 @@ class Display {
     */
     int writeToSSeg(uint16_t score);
 
+    /*
+    Shows two scores side by side (a two player game): the left one on the left half of the 7-segment displays, the right
+    one on the right half, and a display in the middle stays empty if there's an odd number of them. Each score is cut
+    down to its half like writeToSSeg() does
+    */
+    int writeScores(uint16_t left, uint16_t right);
+
     /*
     Not much to say here
     Inputs the screen clearing instruction to the queue manager
@@ -75,19 +86,67 @@ class Display {
     int writeToLCD(char message[]);
 
     /*
-    Function placed in the .ino's loop to call the queue execution function once per frame
+    Function placed in the .ino's loop to run the instruction queue. Every instruction is given its own execution time from
+    the datasheet, so a burst of character writes goes out back to back while a clear gets the 1.5 ms it needs. Returns when
+    the next instruction would have to wait long (see lcdWaitTime()) or it has been busy for lcdBurstTime. A whole message
+    takes about 11 ms from writeToLCD() to its last character (a character is three chain writes of about 38 us each plus
+    the LCD's own 41 us). Interrupts are only off during each chain write
     */
     void lcdInterruptCheck();
     bool lcdInterruptActive;
 
+    /*
+    Microseconds until the LCD can take its next instruction, 0 if it can take one now
+    */
+    uint16_t lcdWaitTime();
+
+    /*
+    How long the last message took from writeToLCD() until its last character was on the screen, in microseconds
+    */
+    unsigned long lcdMessageTime();
+
+    /*
+    What the queue compaction has left out so far. A clear drops every write, clear and return home still waiting before
+    it (the screen is wiped anyway), and a return home right after a clear is dropped (the clear already homes the cursor)
+    */
+    struct LcdQueueStats {
+      uint16_t clearsMerged;
+      uint16_t homesMerged;
+      uint16_t writesCancelled;
+      uint16_t charactersSkipped;
+      // Writes stopped because the message changed under them, the compaction should keep this at 0
+      uint16_t versionAborts;
+    };
+    LcdQueueStats lcdQueueStats();
+
+    /*
+    Gives a function that is called whenever the LCD queue gets work (lcdInterruptActive turns true), so that a task
+    calling lcdInterruptCheck() can sleep while the queue is empty. Can be called from interrupts
+    */
+    void setLcdWakeFunction(void (*function)());
+
+    /*
+    Gives a function that is called when the 7-segment digits start rolling to a new score, it should start calling
+    sSegFrame() every frame. Without one (or with SSEGROLLFLAG 0) new scores show up at once
+    */
+    void setSSegFrameFunction(void (*function)());
+
+    /*
+    Moves the rolling digits one frame on and sends the frame out. Returns false when every digit has arrived and the
+    frames can stop. A new score in the middle of a roll doesn't queue up, the digits turn towards the newest score
+    */
+    bool sSegFrame();
+
+    /*
+    True if a new score rolls in over the following frames, false if writeToSSeg() and writeScores() send it out at once
+    */
+    bool sSegRolls();
+
   protected:
     // The numbers of: 7-segment displays attached, lcd screens attached, Serial-to-Parallel ports required to feed data
     // to all attached displays
     static const uint8_t segmentDisplayAmount = 3, lcdDisplayAmount = 1, stpTotal = (segmentDisplayAmount + (2 * lcdDisplayAmount));
 
-    // The numbers/locations of the pins that are used to control StP ports
-    uint8_t serial, serialClock, registerClock, serialClear, outputEnable;
-
     /*
     The registers that hold data about the desired states of all outputs in the display section
     Structure of a 7-seg register: [A][B][C][D] [E][F][G][x] - letters correspond to outputs leading to individual segments 
@@ -110,6 +169,9 @@ class Display {
     // The the different commands available for the LCD (here as variables because it's eaasier to remember a word than number)
     static const uint8_t pause = 0, clear = 1, moveSet = 2, displaySet = 3, dataSet = 4, write = 5, clrCsr = 6;
 
+    // A digit value for scoreToDigits() that leaves the display empty
+    static const uint8_t blankDigit = 10;
+
     // Number of characters in the message currently being displayed
     uint8_t messageLength;
     // The maximum amount of characters allowed in a message sent to an LCD display (not related to the size of the display)
@@ -123,6 +185,35 @@ class Display {
     // The message that is being written to the LCD display (or was written once writing is done)
     // Max message length is set as 100 here, could be changed if desired
     volatile uint8_t currentMessage[maxMessageLength];
+
+    // Called when the queue gets work, 0 if no one needs to know
+    void (*lcdWakeFunction)();
+
+    // Rolling 7-segment digits: what each digit rolls from and to, what's on it right now, and the frame it's on (0 = still)
+    static const uint8_t rollFrameCount = 3;
+    uint8_t rollFrom[segmentDisplayAmount];
+    uint8_t rollTarget[segmentDisplayAmount];
+    uint8_t rollShown[segmentDisplayAmount];
+    uint8_t rollFrames[segmentDisplayAmount];
+    void (*sSegFrameFunction)();
+
+    // Every writeToLCD() gets a new version, and a write that was started with one version never continues with another
+    volatile uint8_t messageVersion;
+    volatile uint8_t writeVersion;
+    LcdQueueStats queueStats;
+
+    // micros() when the LCD has finished the last instruction and can take the next one
+    volatile unsigned long lcdReadyTime;
+    // When the message being written was given to writeToLCD(), and how long the last whole message took
+    volatile unsigned long messageStartTime;
+    volatile unsigned long messageTime;
+    // lcdInterruptCheck() waits in place for gaps up to lcdSpinTime and keeps going for at most lcdBurstTime (microseconds)
+    static const uint16_t lcdSpinTime = 100, lcdBurstTime = 400;
+
+    /*
+    How long an instruction keeps the LCD busy after the enable pulse, in microseconds
+    */
+    static uint16_t instructionTime(uint8_t instruction);
     
     /*
     Enters the contents of all display-related system registers into the serial-to-parallel chain, then outputs said data onto displays
@@ -131,9 +222,22 @@ class Display {
 
     /*
     Converts a set of digits into the bits required to display that number on a 7-segment display, plus saves said bits into
-    the system's 7-segment-displays' registers
+    the system's 7-segment-displays' registers. Leading zeroes are left empty unless hideLeadingZeroes is false, and
+    blankDigit leaves its display empty
+    */
+    int scoreToDigits(uint8_t digits[], bool hideLeadingZeroes = true);
+
+    /*
+    Shows the 7-segment registers scoreToDigits() just filled: sends them out at once, or with rolling digits keeps the
+    current frame in the registers and starts the digits that changed rolling
+    */
+    int commitSegments();
+
+    /*
+    A digit's segments moved up or down by two rows (of the five: A, F/B, G, E/C, D), the halfway frames of a roll
     */
-    int scoreToDigits(uint8_t digits[]);
+    static uint8_t rollUp(uint8_t segments);
+    static uint8_t rollDown(uint8_t segments);
     
     /*
     Initializes screen with basic settings
@@ -0,0 +1,107 @@
+#include "game.h"
+
+const GameCurve gameCurve = { 1000000, 10, 90, 0, 0 };
+const GameCurve adaptiveCurve = { 1000000, 10, 90, 3, 150000 };
+
+// Response times above this are counted as this, a pause shouldn't take the average with it (ms)
+const uint16_t longestResponse = 3000;
+
+void gameReset(GameState *game, const GameCurve *curve) {
+  for (uint8_t i = 0; i < GAME_HISTORY; i++) {
+    game->targets[i] = -1;
+    game->presses[i] = -1;
+  }
+  game->waiting = 0;
+  game->stepCounter = 0;
+  game->score = 0;
+  game->curve = curve;
+  game->period = curve->startPeriod;
+  // Until the player has shown otherwise, they keep up with the starting tick
+  game->response8 = (curve->startPeriod / 1000) * 8;
+}
+
+/*
+The adaptive curve's controller, all integer math. Behind the band it eases off a sixteenth of the period for each
+target over, ahead of the band it closes an eighth of the gap between the tick and the player's pace (at least 1/64),
+and inside the band it creeps a 1/128 faster so the game still comes to an end
+*/
+static void steer(GameState *game, uint16_t responseTime) {
+  const GameCurve *curve = game->curve;
+  if (responseTime > longestResponse) {
+    responseTime = longestResponse;
+  }
+  game->response8 += responseTime - (game->response8 >> 3);
+  long pace = (long)(game->response8 >> 3) * 1000;
+
+  long period = game->period;
+  int8_t error = game->waiting - curve->targetLag;
+  if (error > 1) {
+    period += (period >> 4) * (error - 1);
+  }
+  else if (error < -1) {
+    long step = (period - pace) >> 3;
+    if (step < (period >> 6)) {
+      step = period >> 6;
+    }
+    period -= step;
+  }
+  else {
+    period -= period >> 7;
+  }
+
+  // No faster than 3/4 of the player's pace or the minimum, no slower than the start
+  if (period < pace - (pace >> 2)) {
+    period = pace - (pace >> 2);
+  }
+  if (period < curve->minPeriod) {
+    period = curve->minPeriod;
+  }
+  if (period > curve->startPeriod) {
+    period = curve->startPeriod;
+  }
+  game->period = period;
+}
+
+bool gameTick(GameState *game, int8_t target) {
+  for (uint8_t i = GAME_HISTORY - 1; i > 0; i--) {
+    game->targets[i] = game->targets[i - 1];
+  }
+  game->targets[0] = target;
+  game->waiting++;
+  return game->waiting >= GAME_HISTORY;
+}
+
+uint8_t gamePress(GameState *game, int8_t button, uint16_t responseTime) {
+  for (uint8_t i = GAME_HISTORY - 1; i > 0; i--) {
+    game->presses[i] = game->presses[i - 1];
+  }
+  game->presses[0] = button;
+
+  // Without a lit target every press is wrong
+  if (game->waiting == 0 || game->targets[game->waiting - 1] != button) {
+    return GAME_MISS;
+  }
+  game->score++;
+  game->waiting--;
+  game->stepCounter++;
+  bool milestone = game->stepCounter >= game->curve->stepHits;
+  if (milestone) {
+    game->stepCounter = 0;
+  }
+
+  if (game->curve->targetLag > 0) {
+    long before = game->period;
+    steer(game, responseTime);
+    if (milestone) {
+      return GAME_SPEEDUP;
+    }
+    return game->period != before ? GAME_ADJUST : GAME_HIT;
+  }
+
+  if (!milestone) {
+    return GAME_HIT;
+  }
+  // Integer math so that the board and the host round the same way
+  game->period = game->period * game->curve->stepPercent / 100;
+  return GAME_SPEEDUP;
+}
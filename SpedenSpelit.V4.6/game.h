@@ -0,0 +1,77 @@
+/*
+The rules of the game without any hardware: which targets are waiting to be pressed, the score and the speed curve.
+The .ino lights the leds, plays the sounds and writes the displays around these calls, and the host tools (host/tuner)
+compile this same file to play millions of games on a PC, so both always follow the same rules.
+
+RULES:
+  - every tick lights a new target, the game is lost when ten targets are waiting
+  - the targets have to be pressed in the order they were lit, a wrong button loses the game
+  - every curve->stepHits hits the tick period is multiplied by curve->stepPercent / 100
+  - or, on an adaptive curve (targetLag > 0), every hit steers the period so that the player stays about targetLag targets
+    behind: a small integer controller on the number of targets waiting and the player's rolling response time. Its only
+    inputs are the ones a replay holds (the order of the events and the milliseconds the press came after the previous
+    event), so a recorded game plays back with exactly the same periods
+
+HOW TO USE:
+  1. gameReset() when a game starts, with the speed curve to use (gameCurve is the one the box plays)
+  2. gameTick() from the tick with the new random target, gamePress() when a button is pressed
+  3. Read score, waiting and period from the GameState as needed. When the period has changed, a fixed curve restarts the
+    tick from the press and an adaptive one lets the tick already waiting keep its time (timerSetPeriod())
+*/
+
+#ifndef GAME_H
+#define GAME_H
+#include <arduino.h>
+
+// How many targets can wait at most (the tenth one loses the game)
+#define GAME_HISTORY 10
+
+// What gamePress() tells about a press
+#define GAME_MISS 0
+#define GAME_HIT 1
+#define GAME_SPEEDUP 2
+#define GAME_ADJUST 3
+
+struct GameCurve {
+  long startPeriod;   // us
+  uint8_t stepHits;
+  uint8_t stepPercent;
+  // Adaptive curves only: how many targets should be waiting, and the shortest period the controller may go to (us)
+  uint8_t targetLag;
+  long minPeriod;
+};
+
+// The curve of the box: 1 s to start with, 10 % faster every ten hits
+extern const GameCurve gameCurve;
+// The adaptive one: starts at 1 s and keeps the player about three targets behind
+extern const GameCurve adaptiveCurve;
+
+struct GameState {
+  // Lit targets, newest first, -1 for none. targets[waiting - 1] is the next one to press
+  int8_t targets[GAME_HISTORY];
+  // Pressed buttons, newest first
+  int8_t presses[GAME_HISTORY];
+  uint8_t waiting;
+  uint8_t stepCounter;
+  uint16_t score;
+  long period;        // us
+  // Adaptive curves: the rolling response time in ms times 8, the newest press weighs 1/8
+  uint16_t response8;
+  const GameCurve *curve;
+};
+
+void gameReset(GameState *game, const GameCurve *curve);
+
+/*
+Lights a new target. Returns true if the game was lost (too many targets waiting)
+*/
+bool gameTick(GameState *game, int8_t target);
+
+/*
+A button was pressed, responseTime milliseconds after the previous event (tick or press) as replayPress() records it.
+Returns GAME_MISS (wrong button or nothing waiting, the game is lost), GAME_HIT, GAME_SPEEDUP (every stepHits hits, on a
+fixed curve the period got shorter) or GAME_ADJUST (an adaptive curve changed the period)
+*/
+uint8_t gamePress(GameState *game, int8_t button, uint16_t responseTime);
+
+#endif
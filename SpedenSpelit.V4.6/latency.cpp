@@ -0,0 +1,160 @@
+#include "latency.h"
+
+volatile bool latencyOn = false;
+// Set by the edge, cleared when every point has been marked (or the edge has gone stale)
+volatile bool edgePending = false;
+volatile unsigned long edgeTime;
+uint8_t pointsMarked;
+
+struct LatencyPoint {
+  uint16_t histogram[LATENCY_BUCKETS];
+  uint16_t count;
+  uint32_t total;
+  uint32_t shortest;
+  uint32_t longest;
+};
+
+LatencyPoint points[LATENCY_POINTS];
+uint16_t overBudget;
+
+void latencyStart(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < LATENCY_POINTS; i++) {
+    for (uint8_t j = 0; j < LATENCY_BUCKETS; j++) {
+      points[i].histogram[j] = 0;
+    }
+    points[i].count = 0;
+    points[i].total = 0;
+    points[i].shortest = 0xFFFFFFFF;
+    points[i].longest = 0;
+  }
+  overBudget = 0;
+  edgePending = false;
+  latencyOn = true;
+  SREG = oldSREG;
+}
+
+void latencyStop(void) {
+  latencyOn = false;
+  latencyReport();
+}
+
+bool latencyActive(void) {
+  return latencyOn;
+}
+
+void latencyEdge(void) {
+  if (!latencyOn) {
+    return;
+  }
+  unsigned long now = micros();
+  // A second button pressed before the first one got its feedback is measured from the first edge
+  if (edgePending && now - edgeTime < LATENCY_TIMEOUT_US) {
+    return;
+  }
+  edgeTime = now;
+  pointsMarked = 0;
+  edgePending = true;
+}
+
+void latencyMark(uint8_t point) {
+  uint8_t oldSREG = SREG;
+  cli();
+  if (!latencyOn || !edgePending || point >= LATENCY_POINTS || (pointsMarked & (1 << point))) {
+    SREG = oldSREG;
+    return;
+  }
+  uint32_t latency = micros() - edgeTime;
+  pointsMarked |= 1 << point;
+  if (pointsMarked == (1 << LATENCY_POINTS) - 1) {
+    edgePending = false;
+  }
+  SREG = oldSREG;
+
+  LatencyPoint &stats = points[point];
+  uint32_t bucket = latency / LATENCY_BUCKET_US;
+  if (bucket >= LATENCY_BUCKETS) {
+    bucket = LATENCY_BUCKETS - 1;
+  }
+  stats.histogram[bucket]++;
+  stats.count++;
+  stats.total += latency;
+  if (latency < stats.shortest) {
+    stats.shortest = latency;
+  }
+  if (latency > stats.longest) {
+    stats.longest = latency;
+  }
+  if (latency > LATENCY_BUDGET_US) {
+    overBudget++;
+  }
+}
+
+/*
+The upper edge of the bucket the given percentile falls in, in microseconds
+*/
+static uint32_t percentile(LatencyPoint &stats, uint8_t percent) {
+  uint16_t needed = ((uint32_t)stats.count * percent + 99) / 100;
+  uint16_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += stats.histogram[i];
+    if (seen >= needed) {
+      return (uint32_t)(i + 1) * LATENCY_BUCKET_US;
+    }
+  }
+  return (uint32_t)LATENCY_BUCKETS * LATENCY_BUCKET_US;
+}
+
+void latencyReport(void) {
+  const char *names[LATENCY_POINTS] = { "reuna -> ledi pois", "reuna -> pisteet näytöllä" };
+  for (uint8_t i = 0; i < LATENCY_POINTS; i++) {
+    LatencyPoint &stats = points[i];
+    Serial.print(names[i]);
+    Serial.print(": ");
+    Serial.print(stats.count);
+    if (stats.count == 0) {
+      Serial.println(" painallusta");
+      continue;
+    }
+    Serial.print(" painallusta, min ");
+    Serial.print(stats.shortest);
+    Serial.print(" us, keskim. ");
+    Serial.print(stats.total / stats.count);
+    Serial.print(" us, p50 < ");
+    Serial.print(percentile(stats, 50));
+    Serial.print(" us, p95 < ");
+    Serial.print(percentile(stats, 95));
+    Serial.print(" us, p99 < ");
+    Serial.print(percentile(stats, 99));
+    Serial.print(" us, max ");
+    Serial.print(stats.longest);
+    Serial.println(" us");
+
+    // One line per bucket that has something in it
+    for (uint8_t j = 0; j < LATENCY_BUCKETS; j++) {
+      if (stats.histogram[j] == 0) {
+        continue;
+      }
+      Serial.print("  ");
+      Serial.print(j);
+      if (j == LATENCY_BUCKETS - 1) {
+        Serial.print("+");
+      }
+      else {
+        Serial.print("-");
+        Serial.print(j + 1);
+      }
+      Serial.print(" ms: ");
+      Serial.println(stats.histogram[j]);
+    }
+  }
+  Serial.print("Yli budjetin (");
+  Serial.print((uint32_t)LATENCY_BUDGET_US);
+  Serial.print(" us): ");
+  Serial.println(overBudget);
+}
+
+uint16_t latencyOverBudget(void) {
+  return overBudget;
+}
@@ -0,0 +1,56 @@
+/*
+Test mode that measures how long the game takes to react to a press: from the button's electrical edge (the pin change
+interrupt) to the target led turning off and to the new score being latched onto the 7-segment displays. Every press
+while the mode is on goes into a histogram, which is printed when the mode is turned off.
+
+The module only needs micros(), so the host simulator can run it against its virtual pins as well (there it times the
+display write only, see host/emulator/emulator.cpp).
+
+HOW TO USE:
+  1. latencyStart() turns the mode on (Serial command 'l' in the .ino), latencyStop() turns it off and prints the results
+  2. latencyEdge() is called from the pin change interrupt when a game button goes down
+  3. latencyMark(LATENCY_LED) when the target led is off, latencyMark(LATENCY_SCORE) when the score has been latched.
+     With rolling 7-segment digits (SSEGROLLFLAG in display.h) the score point is the first frame of the roll, the first
+     change the player sees. It goes out on the next frame, so a press during a roll waits up to a frame period for it
+*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+#include <arduino.h>
+
+// What latencyMark() is told has happened
+#define LATENCY_LED 0
+#define LATENCY_SCORE 1
+#define LATENCY_POINTS 2
+
+// The histogram has LATENCY_BUCKETS buckets LATENCY_BUCKET_US wide, the last one also holds everything longer
+#define LATENCY_BUCKETS 16
+#define LATENCY_BUCKET_US 1000
+// Presses slower than this to react are counted as over the budget
+#define LATENCY_BUDGET_US 10000
+// An edge that hasn't led anywhere in this time (a press the debounce ignored) is dropped
+#define LATENCY_TIMEOUT_US 200000UL
+
+void latencyStart(void);
+
+void latencyStop(void);
+
+bool latencyActive(void);
+
+// Called from the pin change interrupt when a game button is pressed down
+void latencyEdge(void);
+
+// Called when the feedback of the press has reached the player, point is LATENCY_LED or LATENCY_SCORE
+void latencyMark(uint8_t point);
+
+/*
+Prints the minimum, mean, 50/95/99 percentiles, maximum and the histogram of both points over Serial
+*/
+void latencyReport(void);
+
+/*
+Number of measured presses that went over LATENCY_BUDGET_US at either point
+*/
+uint16_t latencyOverBudget(void);
+
+#endif
@@ -1,13 +1,134 @@
 #include "leds.h"
+#include "pitches.h"
+#include "board.h"
 
-int ledNumber0 = A2;
-int ledNumber1 = A3;
-int ledNumber2 = A4;
-int ledNumber3 = A5;
-int eyeLeds = 6;
-int startLed = A0;
 uint8_t brightness = 0;
 
+/*
+  The game leds sit on analog pins A2-A5, which are bits 2-5 of PORTC on the Uno (A0 is bit 0),
+  so the led number only needs a shift to find its bit. The asserts stop the build if the pins
+  are moved somewhere this no longer holds.
+*/
+const uint8_t ledShift = ledPin0 - A0;
+const uint8_t ledBits = 0x0F << ledShift;
+static_assert(ledPin1 == ledPin0 + 1 && ledPin2 == ledPin0 + 2 && ledPin3 == ledPin0 + 3,
+  "game leds must be on consecutive pins");
+static_assert(ledPin0 >= A0 && ledPin3 <= A5, "game leds must be on PORTC (A0-A5)");
+static_assert(startLedPin >= A0 && startLedPin <= A5 && (startLedPin < ledPin0 || startLedPin > ledPin3),
+  "start led must be on PORTC outside the game leds");
+
+/*
+  Animation engine. Every led has a brightness level 0-255 that can be set, faded or pulsed. The game leds and the start
+  led are dimmed with software PWM run from the shared Timer2 sample tick (see audio.cpp): 64 steps per period, so
+  15625 / 64 = 244 Hz, and every tick costs the same five compares and one port write. The eyes use the hardware PWM.
+  Every 64th tick one led's animation moves a step, so each led gets 15625 / 64 / 6 = 40 steps per second and no tick
+  ever does more than one of them. When nothing is animating and every led is fully on or off, the tick is released.
+*/
+#define LED_COUNT 6
+#define PWM_LEDS 5
+// Where the start led and the eyes are in the tables below, LED_START and LED_EYES are their numbers outside
+#define START_ANIMATION 4
+#define EYES_ANIMATION 5
+#define LED_STATIC 0
+#define LED_FADE 1
+#define LED_PULSE 2
+
+struct LedAnimation {
+  uint8_t level;
+  uint8_t target;
+  uint8_t step;
+  uint8_t mode;
+  uint8_t low;
+  uint8_t high;
+};
+
+volatile LedAnimation animations[LED_COUNT];
+// Gamma corrected PWM duty of the software PWM leds, 0 = off, 64 = fully on
+volatile uint8_t duty[PWM_LEDS];
+volatile uint8_t pwmCounter = 0;
+volatile uint8_t animationCounter = 0;
+volatile bool pwmRunning = false;
+
+static void setLevel(uint8_t led, uint8_t level);
+
+// The PORTC bit of each software PWM led (game leds 0-3, start led)
+const uint8_t pwmPortBits[PWM_LEDS] = {
+  1 << (ledPin0 - A0), 1 << (ledPin1 - A0), 1 << (ledPin2 - A0), 1 << (ledPin3 - A0), 1 << (startLedPin - A0)
+};
+const uint8_t pwmBits = ledBits | (1 << (startLedPin - A0));
+
+/*
+  The leds of buttons 4 and up are on their own 74HC595 chain (board.h), bit n is the led of button 4 + n. They are only
+  on or off, a fade or a pulse on one of them just sets it to where the animation would end up
+*/
+typedef FastPin<stpSerialPin> chainSerialPin;
+typedef FastPin<stpSerialClockPin> chainClockPin;
+typedef FastPin<extraLedLatchPin> chainLatchPin;
+const uint16_t extraLedBits = ((uint32_t)1 << extraLedCount) - 1;
+volatile uint16_t extraLeds = 0;
+
+// Brightness (level / 4) to PWM duty with a gamma of 2.2, so fades look even to the eye
+const uint8_t gammaTable[64] PROGMEM = {
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 3,
+  3, 4, 4, 5, 5, 6, 6, 7, 8, 8, 9, 10, 11, 12, 13, 13,
+  14, 15, 16, 18, 19, 20, 21, 22, 24, 25, 26, 28, 29, 31, 32, 34,
+  35, 37, 38, 40, 42, 44, 46, 47, 49, 51, 53, 55, 57, 60, 62, 64
+};
+
+/*
+  Shifts the extra leds out, last chip first and each byte from QH down, so every bit lands on its own output. Call with
+  interrupts disabled, the display chain shares the serial pins (8 bits take about 8 us)
+*/
+static void writeExtraLeds(uint16_t leds) {
+  if (extraLedCount == 0) {
+    return;
+  }
+  extraLeds = leds;
+  for (int8_t chip = extraLedChainLength - 1; chip >= 0; chip--) {
+    uint8_t data = leds >> (8 * chip);
+    for (uint8_t i = 0; i < 8; i++) {
+      if (data & 0x80) {
+        chainSerialPin::high();
+      }
+      else {
+        chainSerialPin::low();
+      }
+      data <<= 1;
+      chainClockPin::high();
+      chainClockPin::low();
+    }
+  }
+  chainLatchPin::high();
+  chainLatchPin::low();
+}
+
+/*
+  Sets the extra leds in group (bits of button 4 and up) to mask, the chain is only written if something changes. Call
+  with interrupts disabled
+*/
+static void setExtraLeds(uint16_t mask, uint16_t group) {
+  uint16_t leds = (extraLeds & ~group) | (mask & group);
+  if (leds != extraLeds) {
+    writeExtraLeds(leds);
+  }
+}
+
+/*
+  The index of a led in the animation tables, -1 for the leds on the 74HC595 chain
+*/
+static int8_t animationIndex(uint8_t led) {
+  if (led < gameLedCount) {
+    return led;
+  }
+  if (led == LED_START) {
+    return START_ANIMATION;
+  }
+  if (led == LED_EYES) {
+    return EYES_ANIMATION;
+  }
+  return -1;
+}
+
 /*
   initializeLeds() subroutine intializes analog pins A2,A3,A4,A5
   to be used as outputs. Speden Spelit leds are connected to those
@@ -16,21 +137,109 @@ uint8_t brightness = 0;
 
 void initializeLeds(){//sets analog pins as outputs
 
-pinMode(ledNumber0, OUTPUT);
-pinMode(ledNumber1, OUTPUT);
-pinMode(ledNumber2, OUTPUT);
-pinMode(ledNumber3, OUTPUT);
-pinMode(eyeLeds, OUTPUT); 
-pinMode(startLed, OUTPUT);
+FastPin<ledPin0>::output();
+FastPin<ledPin1>::output();
+FastPin<ledPin2>::output();
+FastPin<ledPin3>::output();
+FastPin<eyeLedPin>::output();
+FastPin<startLedPin>::output();
+if (extraLedCount > 0) {
+  chainSerialPin::output();
+  chainClockPin::output();
+  chainLatchPin::output();
+}
+
+uint8_t oldSREG = SREG;
+cli();
+for (uint8_t i = 0; i < LED_COUNT; i++) {
+  setLevel(i, 0);
+}
+writeExtraLeds(0);
+SREG = oldSREG;
+}
+
+/*
+  Shows a level on a led. Call with interrupts disabled
+*/
+static void showLevel(uint8_t led) {
+  uint8_t level = animations[led].level;
+  uint8_t value = pgm_read_byte(&gammaTable[level >> 2]);
+  if (level == 255) {
+    value = 64;
+  }
+
+  if (led < PWM_LEDS) {
+    duty[led] = value;
+  }
+  else if (value == 0) {
+    // OCR0A = 0 would still leave a short pulse, so the pin is disconnected from the timer instead
+    TCCR0A &= ~_BV(COM0A1);
+    FastPin<eyeLedPin>::low();
+  }
+  else {
+    OCR0A = (value == 64) ? 255 : value * 4;
+    TCCR0A |= _BV(COM0A1);
+  }
+}
+
+/*
+  Sets a led straight to a level and stops its animation. Call with interrupts disabled
+*/
+static void setLevel(uint8_t led, uint8_t level) {
+  animations[led].mode = LED_STATIC;
+  animations[led].level = level;
+  showLevel(led);
+}
+
+/*
+  While the tick is released every game led is static and fully on or off, and setLedGroup() only writes PORTC. The
+  levels are read back from the port before anything uses them. A led whose animation was just started keeps the level
+  it was given (ledChase()). Call with interrupts disabled
+*/
+static void syncGameLeds() {
+  if (pwmRunning) {
+    return;
+  }
+  uint8_t port = PORTC;
+  for (uint8_t i = 0; i < gameLedCount; i++) {
+    if (animations[i].mode != LED_STATIC) {
+      continue;
+    }
+    bool on = port & pwmPortBits[i];
+    animations[i].level = on ? 255 : 0;
+    duty[i] = on ? 64 : 0;
+  }
+}
+
+/*
+  Starts the shared tick if some led needs PWM or is animating, releases it otherwise. Call with interrupts disabled
+*/
+static void updatePwmRunning() {
+  syncGameLeds();
+  bool needed = false;
+  for (uint8_t i = 0; i < LED_COUNT; i++) {
+    if (animations[i].mode != LED_STATIC || (i < PWM_LEDS && duty[i] != 0 && duty[i] != 64)) {
+      needed = true;
+    }
+  }
+  if (needed != pwmRunning) {
+    pwmRunning = needed;
+    fastTickEnable(FASTTICK_LEDS, needed);
+  }
 }
 
 void startButtonLed(bool state ){
+  uint8_t oldSREG = SREG;
+  cli();
+  setLevel(START_ANIMATION, state ? 255 : 0);
   if(state == 1){
-    digitalWrite(startLed, HIGH);
+    FastPin<startLedPin>::high();
   }
   else if(state == 0){
-    digitalWrite(startLed, LOW);
+    FastPin<startLedPin>::low();
   }
+  updatePwmRunning();
+  SREG = oldSREG;
 }
 /*
   setLed(int) sets correct led number given as 0,1,2 or 3
@@ -38,81 +247,281 @@ void startButtonLed(bool state ){
   led number 1 => Arduino pin A3
   led number 2 => Arduino pin A4
   led number 3 => Arduino pin A5
+  led numbers 4 to buttonCount - 1 are on the 74HC595 chain
   
   parameters:
-  int ledNumber is 0,1,2 or 3
+  int ledNumber is 0 to buttonCount - 1
 */
 void setLed(int ledNumber, bool state){
-  if(ledNumber == 0){
-      if (state == 1){
-      digitalWrite(ledNumber0, HIGH);
-      }
-      else if(state == 0){
-      digitalWrite(ledNumber0, LOW);
-      }
+  if (ledNumber < 0 || ledNumber >= buttonCount) {
+    return;
   }
-  if(ledNumber == 1){
-      if (state == 1){
-      digitalWrite(ledNumber1, HIGH);
-    }
-      else if(state == 0){
-      digitalWrite(ledNumber1, LOW);
-      }
+  uint8_t oldSREG = SREG;
+  cli();
+  if (ledNumber >= gameLedCount) {
+    uint16_t bit = 1 << (ledNumber - gameLedCount);
+    setExtraLeds(state ? bit : 0, bit);
+    SREG = oldSREG;
+    return;
   }
-  if(ledNumber == 2){
-      if (state == 1){
-      digitalWrite(ledNumber2, HIGH);
+  animations[ledNumber].mode = LED_STATIC;
+  animations[ledNumber].level = state ? 255 : 0;
+  duty[ledNumber] = state ? 64 : 0;
+  if (state == 1) {
+    PORTC |= (1 << (ledNumber + ledShift));
   }
-      else if(state == 0){
-      digitalWrite(ledNumber2, LOW);
-      }
+  else {
+    PORTC &= ~(1 << (ledNumber + ledShift));
   }
-  if(ledNumber == 3){
-      if (state == 1){
-      digitalWrite(ledNumber3, HIGH); 
+  // A led fully on or off can't start the PWM, only possibly let it stop
+  if (pwmRunning) {
+    updatePwmRunning();
   }
-      else if(state == 0){
-      digitalWrite(ledNumber3, LOW);
-      }
-}
+  SREG = oldSREG;
 }
 
+/*
+  setLedMask(uint16_t) sets all the game leds with one
+  read-modify-write of PORTC, bit 0 of mask => led number 0 etc.
+  Leds 4 and up go out in one write of their chain, and only when
+  one of them changes. Used from the timer interrupt, so it's kept
+  short and atomic
+*/
+void setLedMask(uint16_t mask){
+  setLedGroup(mask, ((uint32_t)1 << buttonCount) - 1);
+}
 
+/*
+  setLedGroup(uint16_t, uint16_t) is setLedMask() limited to the leds in group,
+  still a single write of PORTC. With the tick released that write is all
+  (syncGameLeds() picks the levels up later), only while something animates
+  do the leds in the group have their animations stopped as well
+*/
+void setLedGroup(uint16_t mask, uint16_t group){
+  uint8_t oldSREG = SREG;
+  cli();
+  if (extraLedCount > 0) {
+    setExtraLeds(mask >> gameLedCount, (group >> gameLedCount) & extraLedBits);
+  }
+  uint8_t bits = (group << ledShift) & ledBits;
+  PORTC = (PORTC & ~bits) | ((mask << ledShift) & bits);
+  if (pwmRunning) {
+    for (uint8_t i = 0; i < gameLedCount; i++) {
+      if (!(group & (1 << i))) {
+        continue;
+      }
+      bool on = mask & (1 << i);
+      animations[i].mode = LED_STATIC;
+      animations[i].level = on ? 255 : 0;
+      duty[i] = on ? 64 : 0;
+    }
+    updatePwmRunning();
+  }
+  SREG = oldSREG;
+}
 
 /*
   clearAllLeds(void) subroutine clears all leds
 */
 void clearAllLeds(void){
 
-  digitalWrite(ledNumber0, LOW);
-  digitalWrite(ledNumber1, LOW);
-  digitalWrite(ledNumber2, LOW);
-  digitalWrite(ledNumber3, LOW);
-  digitalWrite(startLed, LOW);
-  digitalWrite(eyeLeds, LOW);
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < LED_COUNT; i++) {
+    setLevel(i, 0);
+  }
+  // Game leds and the start led are all on PORTC
+  PORTC &= ~pwmBits;
+  setExtraLeds(0, extraLedBits);
+  updatePwmRunning();
+  SREG = oldSREG;
+  brightness = 0;
 
 }
 
 void setAllLeds(void){
 
-  digitalWrite(ledNumber0, HIGH);
-  digitalWrite(ledNumber1, HIGH);
-  digitalWrite(ledNumber2, HIGH);
-  digitalWrite(ledNumber3, HIGH);
-  digitalWrite(startLed, HIGH);
-  digitalWrite(eyeLeds, HIGH);
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < LED_COUNT; i++) {
+    setLevel(i, 255);
+  }
+  PORTC |= pwmBits;
+  setExtraLeds(extraLedBits, extraLedBits);
+  updatePwmRunning();
+  SREG = oldSREG;
+  brightness = 255;
+
+}
+
+/*
+  ledFade() fades a led (0-3 game leds, LED_START, LED_EYES) from its
+  current level to the given one, moving step levels 40 times a second
+*/
+void ledFade(uint8_t led, uint8_t level, uint8_t step){
+  int8_t index = animationIndex(led);
+  if (index < 0) {
+    setLed(led, level >= 128);
+    return;
+  }
+  led = index;
+  uint8_t oldSREG = SREG;
+  cli();
+  syncGameLeds();
+  animations[led].target = level;
+  animations[led].step = step ? step : 1;
+  animations[led].mode = LED_FADE;
+  updatePwmRunning();
+  SREG = oldSREG;
+}
+
+/*
+  ledPulse() makes a led breathe between two levels until it's set to something else
+*/
+void ledPulse(uint8_t led, uint8_t low, uint8_t high, uint8_t step){
+  int8_t index = animationIndex(led);
+  if (index < 0) {
+    setLed(led, true);
+    return;
+  }
+  led = index;
+  uint8_t oldSREG = SREG;
+  cli();
+  syncGameLeds();
+  animations[led].low = low;
+  animations[led].high = high;
+  animations[led].target = high;
+  animations[led].step = step ? step : 1;
+  animations[led].mode = LED_PULSE;
+  updatePwmRunning();
+  SREG = oldSREG;
+}
+
+/*
+  ledChase() runs a wave of light across the game leds on PORTC, each led
+  pulsing a quarter of a cycle after the previous one. It goes through the
+  same PWM and animation steps as ledPulse(), so it runs until the leds are
+  set to something else
+*/
+void ledChase(uint8_t step){
+  // Level and direction a quarter of a cycle (up 255 levels and down again) apart
+  const uint8_t levels[gameLedCount] = { 0, 128, 255, 128 };
+  const uint8_t targets[gameLedCount] = { 255, 0, 0, 255 };
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < gameLedCount; i++) {
+    animations[i].low = 0;
+    animations[i].high = 255;
+    animations[i].step = step ? step : 1;
+    animations[i].level = levels[i];
+    animations[i].target = targets[i];
+    animations[i].mode = LED_PULSE;
+    showLevel(i);
+  }
+  updatePwmRunning();
+  SREG = oldSREG;
+}
+
+/*
+  Moves one led's animation a step. Called from ledTick(), interrupts are already off
+*/
+static void animationStep(uint8_t led) {
+  volatile LedAnimation &animation = animations[led];
+  if (animation.mode == LED_STATIC) {
+    return;
+  }
 
+  uint8_t level = animation.level;
+  uint8_t target = animation.target;
+  if (level < target) {
+    level = (target - level > animation.step) ? level + animation.step : target;
+  }
+  else if (level > target) {
+    level = (level - target > animation.step) ? level - animation.step : target;
+  }
+  animation.level = level;
+
+  if (level == target) {
+    if (animation.mode == LED_PULSE) {
+      animation.target = (target == animation.high) ? animation.low : animation.high;
+    }
+    else {
+      animation.mode = LED_STATIC;
+    }
+  }
+  showLevel(led);
 }
 
+/*
+  ledTick(void) is called from the Timer2 interrupt on every sample while the
+  leds need it: one step of software PWM, plus one led's animation every 64th tick
+*/
+void ledTick(void){
+  uint8_t counter = pwmCounter;
+  uint8_t bits = 0;
+  for (uint8_t i = 0; i < PWM_LEDS; i++) {
+    if (duty[i] > counter) {
+      bits |= pwmPortBits[i];
+    }
+  }
+  PORTC = (PORTC & ~pwmBits) | bits;
+
+  pwmCounter = (counter + 1) & 63;
+  if (pwmCounter == 0) {
+    animationStep(animationCounter);
+    animationCounter++;
+    if (animationCounter >= LED_COUNT) {
+      animationCounter = 0;
+      updatePwmRunning();
+    }
+  }
+}
 
 void eyesOfSpede(){ 
 
-  brightness = brightness * 2 + 1; //adds brightness
+  // Doubled in 16 bits so that the brightness stops at 255 instead of wrapping around to zero
+  uint16_t newBrightness = brightness * 2 + 1; //adds brightness
+
+  if (newBrightness > 255) {
+    newBrightness = 255; // Keeps brightness at the maximum once it gets there
+  }
+  brightness = newBrightness;
+
+  ledFade(LED_EYES, brightness, 8); // Fades the eyes to the new brightness with PWM
+
+}
+
+/*
+  ledBenchmark(void) times what a game tick used to cost for the leds
+  (four setLed() calls with digitalWrite to clear + one to set) against
+  a single setLedMask(), and prints the time per tick over Serial
+*/
+void ledBenchmark(void){
+  #if LEDBENCHFLAG == 1
+  const uint16_t rounds = 1000;
+  const uint8_t pins[] = {ledPin0, ledPin1, ledPin2, ledPin3};
 
-  if (brightness > 255) {
-    brightness = 255; // Returns brightness to zero when it rises over 255
+  unsigned long start = micros();
+  for (uint16_t i = 0; i < rounds; i++) {
+    digitalWrite(ledPin0, LOW);
+    digitalWrite(ledPin1, LOW);
+    digitalWrite(ledPin2, LOW);
+    digitalWrite(ledPin3, LOW);
+    digitalWrite(pins[i & 3], HIGH);
   }
+  unsigned long digitalWriteTime = micros() - start;
 
-  analogWrite(eyeLeds, brightness); // Sends PWM-signal to the leds
+  start = micros();
+  for (uint16_t i = 0; i < rounds; i++) {
+    setLedMask(1 << (i & 3));
+  }
+  unsigned long maskTime = micros() - start;
 
-}
\ No newline at end of file
+  setLedMask(0);
+  Serial.print("Led update per tick, digitalWrite: ");
+  Serial.print(digitalWriteTime / (rounds / 1000.0));
+  Serial.print(" ns, setLedMask: ");
+  Serial.print(maskTime / (rounds / 1000.0));
+  Serial.println(" ns");
+  #endif
+}
@@ -2,10 +2,46 @@
 #define LEDS_H
 #include <arduino.h>
 
+// Set to 1 to time the old digitalWrite() LED update against setLedMask() once at startup (results over Serial)
+#define LEDBENCHFLAG 0
+
 void initializeLeds();
 
 void setLed(int ledNumber, bool state);
 
+/*
+  Sets all the game leds at once, bit n of mask is the led of button n (1 = on).
+  Leds 0-3 are on the same port, so this is a single write (and one more of the
+  74HC595 chain if leds 4 and up change, board.h)
+*/
+void setLedMask(uint16_t mask);
+
+/*
+  Same for a group of leds only, e.g. one player's in a two player game: the leds whose bit is set in group
+  follow mask, the rest keep their state and animation
+*/
+void setLedGroup(uint16_t mask, uint16_t group);
+
+// Animation numbers of the start button led and the eye leds (the game leds are 0 to buttonCount - 1, board.h)
+#define LED_START 16
+#define LED_EYES 17
+
+/*
+  Animations, driven from the Timer2 tick so they never block the loop. Levels are 0-255,
+  step is how much the level moves per animation step (40 steps per second)
+  Setting a led with setLed(), setLedMask() etc. stops its animation
+  The leds of buttons 4 and up can only be on or off: a fade on one of them goes straight to its level, a pulse turns it on
+*/
+void ledFade(uint8_t led, uint8_t level, uint8_t step);
+
+void ledPulse(uint8_t led, uint8_t low, uint8_t high, uint8_t step);
+
+// A wave across game leds 0-3, the ones on the 74HC595 chain are left as they are
+void ledChase(uint8_t step);
+
+// Called from the Timer2 interrupt, see audio.cpp
+void ledTick(void);
+
 void clearAllLeds(void);
 
 void setAllLeds(void);
@@ -14,4 +50,6 @@ void eyesOfSpede(void);
 
 void startButtonLed(bool state);
 
-#endif
\ No newline at end of file
+void ledBenchmark(void);
+
+#endif
@@ -93,6 +93,66 @@
 #define NOTE_DS8 4978
 #define REST      0
 
+/*
+  every pitch above in rising order, starting with the rest
+  a note's position in this list is what the melodies store
+  (see audio.cpp), X is the macro applied to each pitch
+*/
+#define PITCH_LIST(X) X(REST) \
+  X(NOTE_B0) X(NOTE_C1) X(NOTE_CS1) X(NOTE_D1) X(NOTE_DS1) X(NOTE_E1) X(NOTE_F1) X(NOTE_FS1) \
+  X(NOTE_G1) X(NOTE_GS1) X(NOTE_A1) X(NOTE_AS1) X(NOTE_B1) X(NOTE_C2) X(NOTE_CS2) X(NOTE_D2) \
+  X(NOTE_DS2) X(NOTE_E2) X(NOTE_F2) X(NOTE_FS2) X(NOTE_G2) X(NOTE_GS2) X(NOTE_A2) X(NOTE_AS2) \
+  X(NOTE_B2) X(NOTE_C3) X(NOTE_CS3) X(NOTE_D3) X(NOTE_DS3) X(NOTE_E3) X(NOTE_F3) X(NOTE_FS3) \
+  X(NOTE_G3) X(NOTE_GS3) X(NOTE_A3) X(NOTE_AS3) X(NOTE_B3) X(NOTE_C4) X(NOTE_CS4) X(NOTE_D4) \
+  X(NOTE_DS4) X(NOTE_E4) X(NOTE_F4) X(NOTE_FS4) X(NOTE_G4) X(NOTE_GS4) X(NOTE_A4) X(NOTE_AS4) \
+  X(NOTE_B4) X(NOTE_C5) X(NOTE_CS5) X(NOTE_D5) X(NOTE_DS5) X(NOTE_E5) X(NOTE_F5) X(NOTE_FS5) \
+  X(NOTE_G5) X(NOTE_GS5) X(NOTE_A5) X(NOTE_AS5) X(NOTE_B5) X(NOTE_C6) X(NOTE_CS6) X(NOTE_D6) \
+  X(NOTE_DS6) X(NOTE_E6) X(NOTE_F6) X(NOTE_FS6) X(NOTE_G6) X(NOTE_GS6) X(NOTE_A6) X(NOTE_AS6) \
+  X(NOTE_B6) X(NOTE_C7) X(NOTE_CS7) X(NOTE_D7) X(NOTE_DS7) X(NOTE_E7) X(NOTE_F7) X(NOTE_FS7) \
+  X(NOTE_G7) X(NOTE_GS7) X(NOTE_A7) X(NOTE_AS7) X(NOTE_B7) X(NOTE_C8) X(NOTE_CS8) X(NOTE_D8) \
+  X(NOTE_DS8)
+
+/*
+  a melody stored in flash: two bytes per note (pitch
+  position in PITCH_LIST and length code), read by the
+  player one note at a time
+*/
+struct Melody {
+  const uint8_t *notes;
+  uint8_t length;
+  uint8_t priority;
+  bool tempoSynced;
+};
+
+/*
+  the voices that can play at the same time, and the
+  priorities that decide which one is heard (the fail
+  effect is above everything else)
+*/
+#define VOICE_MUSIC 0
+#define VOICE_EFFECT 1
+#define VOICE_CLICK 2
+
+#define PRIORITY_MUSIC 0
+#define PRIORITY_WIN 1
+#define PRIORITY_CLICK 2
+#define PRIORITY_FAIL 3
+
+void initializeAudio(void);
+/*
+  call this function in setup, it prepares the buzzer pin
+  and Timer2 that plays the melodies
+*/
+
+void fastTickEnable(uint8_t user, bool enable);
+/*
+  the Timer2 sample tick (15625 Hz) is shared by the audio
+  and the led animations, each user turns its part on and
+  off and the interrupt runs while anyone needs it
+*/
+#define FASTTICK_AUDIO 1
+#define FASTTICK_LEDS 2
+
 void winEffect(void);
 /*
   call this function whenever the player gets
@@ -104,6 +164,15 @@ void backgroundMusic(void); //call this function when the game starts so there's
   call this function when the start button is pressed
   and the game starts
   stop it when the player fails
+  the music follows the game's tempo: a whole note lasts
+  one game tick, so it speeds up with the game
+*/
+
+void musicTick(long period);
+/*
+  call this function on every game tick with the tick
+  period in microseconds, it keeps the background music
+  on the beat
 */
 
 void failEffect(void);
@@ -118,13 +187,31 @@ void startMusic(void);
 */
 
 
-void playMelody(const int melody[], const int noteDurations[], int melodyLength);
+void playMelody(const Melody *melody, uint8_t voice, bool loop);
 /*
-  this function sets up basic rules for notes
-  such as their duration
+  this function starts a melody on a voice from its first
+  note (or lets it continue if it's already playing), the
+  notes are then played by the Timer2 interrupt
+  a busy voice is only taken over by a melody with at least
+  the same priority, otherwise the new one waits its turn
   all the music functions call this function
 */
 
+void stopMelody(uint8_t voice);
+/*
+  silences one voice
+*/
+
+void buttonSound(void);
+/*
+  short click for every button press, heard over the music
+*/
+
 void gameStateDetect(int);
+/*
+  call this function whenever the game state changes, it
+  starts the music and effects that go with the new state
+  (the effects end by themselves on a timer)
+*/
 
 #endif
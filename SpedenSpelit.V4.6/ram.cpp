@@ -0,0 +1,77 @@
+#include "ram.h"
+
+// Section limits from the linker, and the top of the heap from malloc() (0 while nothing has been allocated)
+extern uint8_t __data_start, __data_end, __bss_start, __bss_end, __heap_start;
+extern void *__brkval;
+
+bool ramWarned = false;
+
+/*
+Paints the free RAM before the C++ constructors and setup() run. The .init3 section runs right after the stack pointer has
+been set, and naked leaves out the function's own entry and exit code, so the stack is still empty here
+*/
+void paintStack(void) __attribute__((naked, used, section(".init3")));
+void paintStack(void) {
+  uint8_t *position = &__heap_start;
+  while (position < (uint8_t *)SP) {
+    *position++ = STACK_PAINT;
+  }
+}
+
+// Where the heap ends (the static variables if malloc() has never been used)
+static uint8_t *heapEnd() {
+  if (__brkval != 0) {
+    return (uint8_t *)__brkval;
+  }
+  return &__heap_start;
+}
+
+uint16_t freeRam(void) {
+  uint8_t top;
+  return &top - heapEnd();
+}
+
+uint16_t stackUnused(void) {
+  uint8_t *position = heapEnd();
+  uint8_t *stack = (uint8_t *)SP;
+  uint16_t unused = 0;
+  while (position < stack && *position == STACK_PAINT) {
+    position++;
+    unused++;
+  }
+  return unused;
+}
+
+uint16_t ramData(void) {
+  return &__data_end - &__data_start;
+}
+
+uint16_t ramBss(void) {
+  return &__bss_end - &__bss_start;
+}
+
+void ramReport(void) {
+  Serial.print("RAM: data ");
+  Serial.print(ramData());
+  Serial.print(" B, bss ");
+  Serial.print(ramBss());
+  Serial.print(" B, vapaana nyt ");
+  Serial.print(freeRam());
+  Serial.print(" B, pino ei ole koskaan käyttänyt ");
+  Serial.print(stackUnused());
+  Serial.print(" B / ");
+  Serial.print(RAMEND - RAMSTART + 1);
+  Serial.println(" B");
+}
+
+bool ramCheck(void) {
+  if (stackUnused() >= RAM_WARNING_MARGIN) {
+    return true;
+  }
+  if (!ramWarned) {
+    ramWarned = true;
+    Serial.print("VAROITUS: pino lähellä muuttujia! ");
+    ramReport();
+  }
+  return false;
+}
@@ -0,0 +1,50 @@
+/*
+Keeps an eye on the 2 KB of RAM. Static variables (.data and .bss) sit at the bottom of the RAM and the stack grows down from
+the top, whatever is between them is free. If the stack ever reaches the variables the board resets or goes haywire.
+
+At startup, before setup(), the free area is painted with a known byte. The stack overwrites the paint as it grows, so the
+paint still left shows the deepest the stack has ever been (the high-water mark), not just how deep it happens to be now.
+
+How much each file takes of the static RAM is a build-time question, see host/ramreport.sh.
+
+HOW TO USE:
+  1. Call ramCheck() every now and then (e.g. from a slow task), it warns over Serial once if the stack gets too close
+  2. ramReport() prints the whole picture, freeRam() and stackUnused() give the numbers
+*/
+
+#ifndef RAM_H
+#define RAM_H
+#include <arduino.h>
+
+// The byte the free area is painted with
+#define STACK_PAINT 0xC5
+// ramCheck() warns when fewer bytes than this have always stayed unused
+#define RAM_WARNING_MARGIN 128
+
+/*
+Bytes free right now between the static variables (or the heap) and the stack
+*/
+uint16_t freeRam(void);
+
+/*
+Bytes that the stack has never touched since startup, the smallest freeRam() there has ever been
+*/
+uint16_t stackUnused(void);
+
+/*
+Sizes of the static data (initialised variables) and bss (zeroed variables) sections
+*/
+uint16_t ramData(void);
+uint16_t ramBss(void);
+
+/*
+Prints the static sizes, the free RAM and the stack high-water mark over Serial
+*/
+void ramReport(void);
+
+/*
+Prints a warning (once) when the stack has come within RAM_WARNING_MARGIN bytes of the variables. Returns false if it has
+*/
+bool ramCheck(void);
+
+#endif
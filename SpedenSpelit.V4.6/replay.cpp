@@ -0,0 +1,556 @@
+#include "replay.h"
+#include <EEPROM.h>
+
+// The ring buffer. Without the EEPROM it holds the whole recording, with it only the bytes not written there yet. ringStart
+// is the oldest byte still kept
+volatile uint8_t replayRing[REPLAY_BUFFER_SIZE];
+volatile uint16_t ringStart = 0;
+volatile uint16_t ringLength = 0;
+// Set when bytes of the recording were lost (the start overwritten in the ring, or the end not fitting in the EEPROM slot),
+// such a recording can't be played back
+volatile bool ringOverflow = false;
+// Recording is on between replayBegin() and replayEnd(), complete tells that the recording holds a whole game
+volatile bool recording = false;
+volatile bool recordingComplete = false;
+volatile unsigned long lastEventTime = 0;
+
+// Work that is too slow for interrupts, done in replayCheck()
+volatile bool dumpRequested = false;
+volatile int finishedScore = 0;
+
+#if REPLAY_EEPROM == 1
+// Each slot starts with a marker, the length of the recording and the score (2 bytes each, little endian), then the stream
+#define SLOT_HEADER 5
+#define SLOT_DATA (REPLAY_SLOT_SIZE - SLOT_HEADER)
+
+// What replayCheck() writes to the EEPROM next, one byte per call
+#define SAVE_IDLE 0
+#define SAVE_CLEAR 1   // unmark the slot before the game in it gets overwritten
+#define SAVE_DATA 2    // the bytes waiting in the ring
+#define SAVE_HEADER 3  // length and score, the marker last
+#define SAVE_UNMARK 4  // unmark the other slot, its game isn't the best anymore
+
+// Marks a saved game. Games saved with 'R' numbered the buttons by pin (9-12) and can't be played back anymore
+const uint8_t eepromMarker = 'B';
+
+// The slot the recording is written to (or was loaded from) and how many of its bytes are in the EEPROM
+volatile uint8_t savedSlot = 0;
+volatile uint16_t savedLength = 0;
+volatile uint8_t saveState = SAVE_IDLE;
+uint8_t headerStep;
+#endif
+
+// Playback state
+volatile bool playing = false;
+volatile bool playbackDone = false;
+void (*playbackTickFunction)();
+void (*playbackPressFunction)(int);
+uint32_t playbackSeed;
+uint8_t playbackCurve;
+uint16_t playbackPressDelta;
+uint16_t playbackPosition;
+unsigned long playbackPeriod;
+unsigned long playbackLastTick;
+unsigned long playbackLastEvent;
+volatile uint8_t expectedTarget;
+volatile uint8_t playbackMismatches;
+volatile bool playbackScoreMatched;
+
+/*
+Adds a byte to the end of the ring, dropping the oldest one if the ring is full. With the EEPROM the ring is only a queue for
+the writer and the start of the game matters more, so there a byte that doesn't fit is dropped instead. Call with interrupts
+disabled
+*/
+static void ringPut(uint8_t data) {
+  #if REPLAY_EEPROM == 1
+  if (ringLength >= REPLAY_BUFFER_SIZE || savedLength + ringLength >= SLOT_DATA) {
+    ringOverflow = true;
+    return;
+  }
+  #endif
+  uint16_t position = ringStart + ringLength;
+  if (position >= REPLAY_BUFFER_SIZE) {
+    position -= REPLAY_BUFFER_SIZE;
+  }
+  replayRing[position] = data;
+
+  if (ringLength < REPLAY_BUFFER_SIZE) {
+    ringLength++;
+  }
+  else {
+    ringStart++;
+    if (ringStart >= REPLAY_BUFFER_SIZE) {
+      ringStart = 0;
+    }
+    ringOverflow = true;
+  }
+}
+
+/*
+Reads the byte at the given position counted from the start of the recording
+*/
+static uint8_t ringGet(uint16_t position) {
+  position += ringStart;
+  if (position >= REPLAY_BUFFER_SIZE) {
+    position -= REPLAY_BUFFER_SIZE;
+  }
+  return replayRing[position];
+}
+
+#if REPLAY_EEPROM == 1
+static int slotAddress(uint8_t slot) {
+  return REPLAY_EEPROM_ADDRESS + slot * REPLAY_SLOT_SIZE;
+}
+
+// Reads a 2 byte header field (1 = length, 3 = score)
+static uint16_t slotWord(uint8_t slot, uint8_t offset) {
+  int address = slotAddress(slot) + offset;
+  return EEPROM.read(address) | (EEPROM.read(address + 1) << 8);
+}
+
+/*
+The slot of the best saved game, -1 if there's none. A reset between marking a new best game and unmarking the old one
+leaves both marked, the higher score is the best then
+*/
+static int8_t bestSlot() {
+  int8_t best = -1;
+  for (uint8_t slot = 0; slot < 2; slot++) {
+    if (EEPROM.read(slotAddress(slot)) != eepromMarker || slotWord(slot, 1) > SLOT_DATA) {
+      continue;
+    }
+    if (best < 0 || slotWord(slot, 3) > slotWord(best, 3)) {
+      best = slot;
+    }
+  }
+  return best;
+}
+#endif
+
+/*
+Length of the recording and its byte at the given position: in the EEPROM slot or in the ring
+*/
+static uint16_t recordedLength() {
+  #if REPLAY_EEPROM == 1
+  return savedLength;
+  #else
+  return ringLength;
+  #endif
+}
+
+static uint8_t recordedByte(uint16_t position) {
+  #if REPLAY_EEPROM == 1
+  return EEPROM.read(slotAddress(savedSlot) + SLOT_HEADER + position);
+  #else
+  return ringGet(position);
+  #endif
+}
+
+static void putVarint(uint32_t value) {
+  while (value > 0x7F) {
+    ringPut((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  ringPut(value);
+}
+
+/*
+Reads a varint starting from position and moves position past it
+*/
+static uint32_t getVarint(uint16_t &position) {
+  uint32_t value = 0;
+  uint8_t shift = 0;
+  uint8_t data;
+  do {
+    data = recordedByte(position++);
+    value |= (uint32_t)(data & 0x7F) << shift;
+    shift += 7;
+  } while ((data & 0x80) && position < recordedLength() && shift < 32);
+  return value;
+}
+
+/*
+Adds an event to the recording. Presses come from the loop and ticks from the timer interrupt, so the write is made atomic
+*/
+static void recordEvent(uint32_t value) {
+  uint8_t oldSREG = SREG;
+  cli();
+  putVarint(value);
+  lastEventTime = millis();
+  SREG = oldSREG;
+}
+
+void replayBegin(uint32_t seed, long period, uint8_t curve) {
+  // initializeGame() calls this during playback as well, the recording being played must stay intact
+  if (playing) {
+    return;
+  }
+
+  #if REPLAY_EEPROM == 1
+  // The game goes to the slot that doesn't hold the best one. What's left unsaved of the previous game is dropped, that only
+  // happens when a game starts a fraction of a second after the last one ended
+  int8_t best = bestSlot();
+  #endif
+
+  uint8_t oldSREG = SREG;
+  cli();
+  ringStart = 0;
+  ringLength = 0;
+  ringOverflow = false;
+  recordingComplete = false;
+  #if REPLAY_EEPROM == 1
+  savedSlot = best == 0 ? 1 : 0;
+  savedLength = 0;
+  saveState = SAVE_CLEAR;
+  #endif
+  for (int i = 0; i < 4; i++) {
+    ringPut((seed >> (8 * i)) & 0xFF);
+  }
+  putVarint(period);
+  if (curve != 0) {
+    putVarint(((uint32_t)curve << 3) | 7);
+  }
+  lastEventTime = millis();
+  recording = true;
+  SREG = oldSREG;
+}
+
+void replayTick(uint8_t target) {
+  if (playing) {
+    if (target != expectedTarget) {
+      playbackMismatches++;
+    }
+    return;
+  }
+  if (recording) {
+    recordEvent(((uint32_t)target << 3) | 1);
+  }
+}
+
+uint16_t replayPress(uint8_t button) {
+  if (playing) {
+    return playbackPressDelta;
+  }
+  if (!recording) {
+    return 0;
+  }
+  uint32_t delta = millis() - lastEventTime;
+  if (delta > 0xFFFF) {
+    delta = 0xFFFF;
+  }
+  recordEvent((delta << 5) | ((button & 0x0F) << 1));
+  return delta;
+}
+
+void replayPeriod(long period) {
+  if (playing) {
+    // The press that changed the period is being played, its recorded change comes right after it
+    uint16_t position = playbackPosition;
+    uint32_t value = getVarint(position);
+    if ((value & 7) == 3 && (long)(value >> 3) == period) {
+      // The game restarted its tick at the press (startPlayerTimer()), so the next tick is a period after the press
+      playbackPeriod = period;
+      playbackLastTick = playbackLastEvent;
+      playbackPosition = position;
+    }
+    else {
+      playbackMismatches++;
+    }
+    return;
+  }
+  if (recording) {
+    recordEvent(((uint32_t)period << 3) | 3);
+  }
+}
+
+void replaySetPeriod(long period) {
+  if (playing) {
+    playbackPeriod = period;
+  }
+}
+
+void replayEnd(int score) {
+  if (playing) {
+    // The game should end exactly where the recording does
+    uint16_t position = playbackPosition;
+    uint32_t value = getVarint(position);
+    playbackScoreMatched = ((value & 7) == 5 && (int)(value >> 3) == score);
+    playing = false;
+    playbackDone = true;
+    return;
+  }
+  if (!recording) {
+    return;
+  }
+
+  recordEvent(((uint32_t)score << 3) | 5);
+  recording = false;
+  recordingComplete = !ringOverflow;
+  finishedScore = score;
+
+  #if REPLAY_SERIAL == 1
+  dumpRequested = true;
+  #endif
+}
+
+bool replayStartPlayback(void (*tickFunction)(), void (*pressFunction)(int)) {
+  if (recording || !recordingComplete || replaySaving()) {
+    return false;
+  }
+
+  playbackTickFunction = tickFunction;
+  playbackPressFunction = pressFunction;
+
+  playbackSeed = 0;
+  for (int i = 0; i < 4; i++) {
+    playbackSeed |= (uint32_t)recordedByte(i) << (8 * i);
+  }
+  playbackPosition = 4;
+  playbackPeriod = getVarint(playbackPosition);
+  playbackCurve = 0;
+  if (playbackPosition < recordedLength()) {
+    uint16_t position = playbackPosition;
+    uint32_t value = getVarint(position);
+    if ((value & 7) == 7) {
+      playbackCurve = value >> 3;
+      playbackPosition = position;
+    }
+  }
+
+  playbackLastTick = micros();
+  playbackLastEvent = playbackLastTick;
+  playbackMismatches = 0;
+  playbackScoreMatched = false;
+  playbackDone = false;
+  playing = true;
+  return true;
+}
+
+void replayAbort(void) {
+  if (!playing) {
+    recording = false;
+  }
+}
+
+void replayStopPlayback(void) {
+  playing = false;
+}
+
+bool replaySaving(void) {
+  #if REPLAY_EEPROM == 1
+  // During the game the writer only has work when the ring has bytes, after it until the header and marker are in
+  return saveState != SAVE_IDLE && (saveState != SAVE_DATA || ringLength > 0 || !recording);
+  #else
+  return false;
+  #endif
+}
+
+bool replayPlaying(void) {
+  return playing;
+}
+
+uint32_t replaySeed(void) {
+  return playbackSeed;
+}
+
+uint8_t replayCurve(void) {
+  return playbackCurve;
+}
+
+/*
+Fires every playback event that is due. Times are kept in microseconds from the planned time of the previous event, so lateness
+in the loop doesn't accumulate over the game
+*/
+static void playbackStep() {
+  while (playing && playbackPosition < recordedLength()) {
+    uint16_t position = playbackPosition;
+    uint32_t value = getVarint(position);
+    unsigned long now = micros();
+
+    if ((value & 1) == 0) {
+      unsigned long due = playbackLastEvent + (value >> 5) * 1000UL;
+      if ((long)(now - due) < 0) {
+        return;
+      }
+      playbackLastEvent = due;
+      playbackPosition = position;
+      playbackPressDelta = (value >> 5) > 0xFFFF ? 0xFFFF : (value >> 5);
+      playbackPressFunction((value >> 1) & 0x0F);
+    }
+    else if ((value & 7) == 1) {
+      unsigned long due = playbackLastTick + playbackPeriod;
+      if ((long)(now - due) < 0) {
+        return;
+      }
+      playbackLastTick = due;
+      playbackLastEvent = due;
+      playbackPosition = position;
+      expectedTarget = value >> 3;
+      playbackTickFunction();
+    }
+    else if ((value & 7) == 3) {
+      // replayPeriod() takes the changes the game makes, one left over here is a change the game didn't make
+      playbackPeriod = value >> 3;
+      playbackLastTick = playbackLastEvent;
+      playbackPosition = position;
+      playbackMismatches++;
+    }
+    else {
+      // The recording ended but the game is still going
+      playing = false;
+      playbackDone = true;
+    }
+  }
+  if (playing) {
+    playing = false;
+    playbackDone = true;
+  }
+}
+
+uint16_t replayWaitTime(void) {
+  if (!playing || playbackPosition >= recordedLength()) {
+    return 0;
+  }
+  uint16_t position = playbackPosition;
+  uint32_t value = getVarint(position);
+  unsigned long due;
+  if ((value & 1) == 0) {
+    due = playbackLastEvent + (value >> 5) * 1000UL;
+  }
+  else if ((value & 7) == 1) {
+    due = playbackLastTick + playbackPeriod;
+  }
+  else {
+    return 0;
+  }
+  long left = due - micros();
+  if (left <= 0) {
+    return 0;
+  }
+  return left / 1000 > 0xFFFF ? 0xFFFF : left / 1000;
+}
+
+#if REPLAY_EEPROM == 1
+/*
+Writes the next byte of the recording to the EEPROM if the previous write has finished. A write takes 3.3 ms, waiting for
+all of them at once would stall everything else for most of a second. Only a complete game that beats the saved best gets
+the marker, and it goes in last so that a reset mid-save never leaves a broken game marked
+*/
+static void saveStep() {
+  if (saveState == SAVE_IDLE || !eeprom_is_ready()) {
+    return;
+  }
+  int address = slotAddress(savedSlot);
+
+  if (saveState == SAVE_CLEAR) {
+    EEPROM.update(address, 0xFF);
+    saveState = SAVE_DATA;
+  }
+  else if (saveState == SAVE_DATA) {
+    // Read before the ring, replayEnd() adds the last byte before it ends the recording
+    bool more = recording;
+    if (ringLength > 0) {
+      EEPROM.update(address + SLOT_HEADER + savedLength, ringGet(0));
+      uint8_t oldSREG = SREG;
+      cli();
+      ringStart = ringStart + 1 >= REPLAY_BUFFER_SIZE ? 0 : ringStart + 1;
+      ringLength--;
+      savedLength++;
+      SREG = oldSREG;
+    }
+    else if (!more) {
+      int8_t best = bestSlot();
+      if (recordingComplete && (best < 0 || (int)slotWord(best, 3) < finishedScore)) {
+        saveState = SAVE_HEADER;
+        headerStep = 1;
+      }
+      else {
+        saveState = SAVE_IDLE;
+      }
+    }
+  }
+  else if (saveState == SAVE_HEADER) {
+    // Steps 1-4 are the length and the score, step 0 the marker
+    uint8_t header[SLOT_HEADER] = { eepromMarker, (uint8_t)(savedLength & 0xFF), (uint8_t)(savedLength >> 8),
+                                    (uint8_t)(finishedScore & 0xFF), (uint8_t)(finishedScore >> 8) };
+    EEPROM.update(address + headerStep, header[headerStep]);
+    if (headerStep == 0) {
+      saveState = SAVE_UNMARK;
+    }
+    else {
+      headerStep = headerStep == SLOT_HEADER - 1 ? 0 : headerStep + 1;
+    }
+  }
+  else {
+    EEPROM.update(slotAddress(1 - savedSlot), 0xFF);
+    saveState = SAVE_IDLE;
+  }
+}
+#endif
+
+bool replayLoad(void) {
+  #if REPLAY_EEPROM == 1
+  if (recording || playing || replaySaving()) {
+    return false;
+  }
+  int8_t best = bestSlot();
+  if (best < 0) {
+    return false;
+  }
+  savedSlot = best;
+  savedLength = slotWord(best, 1);
+  ringOverflow = false;
+  recordingComplete = true;
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+void replayCheck(void) {
+  if (playing) {
+    playbackStep();
+  }
+
+  if (playbackDone) {
+    playbackDone = false;
+    if (playbackMismatches == 0 && playbackScoreMatched) {
+      Serial.println("Toisto vastasi tallennusta");
+    }
+    else {
+      Serial.print("Toisto poikkesi tallennuksesta, vääriä kohteita tai jaksoja: ");
+      Serial.println(playbackMismatches);
+    }
+  }
+
+  #if REPLAY_EEPROM == 1
+  saveStep();
+  #endif
+
+  // The dump reads the EEPROM, so it waits until the game is all there
+  if (dumpRequested && !replaySaving()) {
+    dumpRequested = false;
+    replayDump();
+  }
+}
+
+void replayDump(void) {
+  if (ringOverflow) {
+    #if REPLAY_EEPROM == 1
+    Serial.print("REPLAY_HEAD ");
+    #else
+    Serial.print("REPLAY_TAIL ");
+    #endif
+  }
+  else {
+    Serial.print("REPLAY ");
+  }
+  uint16_t length = recordedLength();
+  for (uint16_t i = 0; i < length; i++) {
+    uint8_t data = recordedByte(i);
+    if (data < 0x10) {
+      Serial.print('0');
+    }
+    Serial.print(data, HEX);
+  }
+  Serial.println();
+}
@@ -0,0 +1,135 @@
+/*
+Records every game as a compact byte stream so that it can be played back through the real game logic later (disputed games,
+timing bugs). The stream is written to the EEPROM as the game goes (a RAM ring holds the bytes until they're written) and
+can be dumped over Serial. The EEPROM has two slots, one keeps the best game and the other takes the game being played.
+
+STREAM FORMAT:
+  Header: 4 bytes of random seed (little endian), then the starting tick period in microseconds as a varint. A game played
+  on another curve than the fixed one (game.h) continues with that curve's number as a v & 7 == 7 event
+  After that every event is one varint (7 bits per byte, LSB first, top bit set on all but the last byte):
+    v & 1 == 0  button press, button = (v >> 1) & 0x0F, milliseconds since the previous event = v >> 5
+    v & 7 == 1  timer tick, lit target = v >> 3 (tick time = previous tick + current period)
+    v & 7 == 3  tick period changed, new period in microseconds = v >> 3 (only the fixed curve, the adaptive one works the
+                period out from the presses and playback gets it the same way)
+    v & 7 == 5  game over, final score = v >> 3
+    v & 7 == 7  speed curve, curve number = v >> 3 (only right after the header)
+  Over Serial a recording is printed as a single line: "REPLAY " followed by the stream in hex ("REPLAY_HEAD " if the game
+  didn't fit in its EEPROM slot and the end is missing, "REPLAY_TAIL " if it didn't fit in the ring without the EEPROM and
+  the start is missing)
+
+HOW TO USE:
+  1. Call replayBegin() when a game starts, replayTick()/replayPress()/replayPeriod() as things happen and replayEnd() when it's lost
+  2. Place replayCheck(); in the loop function, it runs playback and the slow Serial/EEPROM work outside of interrupts. It
+    writes one EEPROM byte per call, call it again in a few ms while replaySaving() is true
+  3. replayStartPlayback() feeds the last recording back through the given tick and press functions. The game logic calls
+    replayPeriod() as it does when recording, and every period that differs from the recorded one counts as a mismatch.
+    Periods that the game logic works out from the presses alone go to replaySetPeriod() instead, they aren't recorded
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+#include <arduino.h>
+
+// 1 = print every finished game over Serial, 0 = only when asked for with replayDump()
+#define REPLAY_SERIAL 0
+// 1 = record to the EEPROM and keep the best game so far there, 0 = don't touch the EEPROM
+#define REPLAY_EEPROM 1
+// Where the saved games start in the EEPROM (the bytes before this are left for settings)
+#define REPLAY_EEPROM_ADDRESS 64
+// Size of each of the two slots. 2 x 480 bytes fill the rest of the Uno's 1 KB, a game takes about 4 bytes per point so a
+// slot holds about 120 points. A game that doesn't fit is kept up to there, but can't be played back
+#define REPLAY_SLOT_SIZE 480
+
+#if REPLAY_EEPROM == 1
+// Size of the RAM ring in bytes. It only holds the bytes not written yet: a byte is written every few ms and a game makes
+// a few bytes per second
+#define REPLAY_BUFFER_SIZE 64
+#else
+// Size of the RAM ring in bytes. A game that doesn't fit keeps its newest bytes, but can't be played back anymore
+#define REPLAY_BUFFER_SIZE 192
+#endif
+
+/*
+Starts a new recording. Parameters: the seed given to randomSeed(), the tick period the game starts with (microseconds)
+and the number of the speed curve (0 = the fixed one, not recorded)
+*/
+void replayBegin(uint32_t seed, long period, uint8_t curve);
+
+/*
+Records a timer tick and the target that was lit. During playback checks that the same target came up again
+*/
+void replayTick(uint8_t target);
+
+/*
+Records a button press (button id 0-15, as given to the press function). Returns the milliseconds since the previous event
+as they went into the recording, during playback the recorded ones, so game logic using them plays back the same. Call it
+with interrupts off in the same stretch that applies the press, a tick recorded in between would play back in the wrong order
+*/
+uint16_t replayPress(uint8_t button);
+
+/*
+Records a change in the tick period (microseconds). During playback checks it against the recorded change
+*/
+void replayPeriod(long period);
+
+/*
+Tells about a change in the tick period that isn't recorded because the game logic works it out again from the recorded
+presses (the adaptive curve). During playback the ticks after it come with the new period
+*/
+void replaySetPeriod(long period);
+
+/*
+Closes the recording with the final score. During playback ends the playback and prints whether the game matched
+*/
+void replayEnd(int score);
+
+/*
+Starts playing back the last complete recording. Returns false if there's nothing to play (or it's still being saved).
+tickFunction is called for every recorded tick, pressFunction for every recorded press
+*/
+bool replayStartPlayback(void (*tickFunction)(), void (*pressFunction)(int));
+
+/*
+Drops a recording that was started but won't be finished (a game that can't be recorded starts instead). The last
+complete recording is gone already, replayBegin() overwrote it
+*/
+void replayAbort(void);
+
+// Stops a playback midway (e.g. someone pressed start)
+void replayStopPlayback(void);
+
+// True while replayCheck() has EEPROM writes to do (it does one per call, a write takes 3.3 ms)
+bool replaySaving(void);
+
+// True while a recording is being played back
+bool replayPlaying(void);
+
+// The seed of the recording being played back
+uint32_t replaySeed(void);
+
+// The speed curve number of the recording being played back
+uint8_t replayCurve(void);
+
+/*
+Function placed in the .ino's loop. Fires due playback events and does deferred Serial prints and EEPROM saves
+*/
+void replayCheck(void);
+
+/*
+Milliseconds until the next playback event is due, rounded down (0 = due now or nothing playing). A task running
+replayCheck() can sleep this long between events instead of polling
+*/
+uint16_t replayWaitTime(void);
+
+/*
+Prints the recording over Serial (format at the top of this file)
+*/
+void replayDump(void);
+
+/*
+Picks the best game saved in the EEPROM as the one to dump or play back. Returns false if there's none or a game is still
+being recorded or saved
+*/
+bool replayLoad(void);
+
+#endif
@@ -0,0 +1,221 @@
+#include "scheduler.h"
+#include "timers.h"
+#include <avr/sleep.h>
+#include <avr/power.h>
+
+Task *tasks[TASK_SLOTS];
+// Bit n is set when the task with priority n should run
+volatile uint8_t readyTasks = 0;
+
+#if SCHEDULER_STATS == 1
+SchedulerStats stats;
+unsigned long statsSince = 0;
+// Sleep times are added up in microseconds and moved over to sleptMillis a whole millisecond at a time
+uint16_t sleptMicros = 0;
+#endif
+
+/*
+Marks a task ready. The time it became ready is noted so the wait until it runs can be measured. Call with interrupts disabled
+*/
+static void makeReady(Task *task) {
+  #if SCHEDULER_STATS == 1
+  if ((readyTasks & task->bit) == 0) {
+    task->readySince = micros();
+  }
+  #endif
+  readyTasks |= task->bit;
+}
+
+/*
+All sleeping tasks share one wheel timer, which is always set to the nearest wake time. With at most eight tasks looking
+through all of them is quicker than keeping them sorted
+*/
+static void deadlineReached();
+SoftTimer deadlineTimer = { &deadlineReached, TIMER_ISR };
+
+// Sets deadlineTimer for the nearest wake time. Call with interrupts disabled
+static void armDeadline() {
+  uint32_t now = timersNow();
+  bool any = false;
+  int32_t nearest = 0;
+  for (uint8_t i = 0; i < TASK_SLOTS; i++) {
+    Task *task = tasks[i];
+    if (task == 0 || !task->sleeping) {
+      continue;
+    }
+    int32_t left = task->wakeTime - now;
+    if (left < 0) {
+      left = 0;
+    }
+    if (!any || left < nearest) {
+      nearest = left;
+      any = true;
+    }
+  }
+
+  if (any) {
+    timerStart(&deadlineTimer, nearest, 0);
+  }
+  else {
+    timerCancel(&deadlineTimer);
+  }
+}
+
+static void deadlineReached() {
+  uint32_t now = timersNow();
+  for (uint8_t i = 0; i < TASK_SLOTS; i++) {
+    Task *task = tasks[i];
+    if (task != 0 && task->sleeping && (int32_t)(now - task->wakeTime) >= 0) {
+      task->sleeping = false;
+      makeReady(task);
+    }
+  }
+  armDeadline();
+}
+
+void initializeScheduler(void) {
+  ADCSRA &= ~(1 << ADEN);
+  ACSR |= (1 << ACD);
+  power_adc_disable();
+  power_twi_disable();
+  schedulerStatsClear();
+}
+
+/*
+Sleeps until the next interrupt if there is nothing to do. Interrupts stay off from the check to the sleep instruction (sei
+lets one more instruction run before any interrupt), so a wake-up can't slip in between and leave the MCU asleep
+*/
+static void idleSleep() {
+  cli();
+  if (readyTasks != 0 || timersPending()) {
+    sei();
+    return;
+  }
+  #if SCHEDULER_STATS == 1
+  unsigned long start = micros();
+  #endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+
+  #if SCHEDULER_STATS == 1
+  sleptMicros += micros() - start;
+  while (sleptMicros >= 1000) {
+    sleptMicros -= 1000;
+    stats.sleptMillis++;
+  }
+  stats.sleeps++;
+  #endif
+}
+
+void taskAdd(Task *task, uint8_t priority) {
+  if (priority >= TASK_SLOTS || tasks[priority] == task) {
+    return;
+  }
+  uint8_t oldSREG = SREG;
+  cli();
+  task->resumeLine = 0;
+  task->sleeping = false;
+  task->bit = 1 << priority;
+  tasks[priority] = task;
+  makeReady(task);
+  SREG = oldSREG;
+}
+
+void taskWake(Task *task) {
+  uint8_t oldSREG = SREG;
+  cli();
+  makeReady(task);
+  SREG = oldSREG;
+}
+
+void taskSleep(Task *task, uint16_t ms) {
+  uint8_t oldSREG = SREG;
+  cli();
+  task->wakeTime = timersNow() + ms;
+  task->sleeping = true;
+  armDeadline();
+  SREG = oldSREG;
+}
+
+void schedulerRun(void) {
+  timersRun();
+
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t ready = readyTasks;
+  if (ready == 0) {
+    SREG = oldSREG;
+    #if SCHEDULER_SLEEP == 1
+    idleSleep();
+    #endif
+    return;
+  }
+  // The lowest set bit is the most urgent task
+  uint8_t priority = 0;
+  while ((ready & 1) == 0) {
+    ready >>= 1;
+    priority++;
+  }
+  Task *task = tasks[priority];
+  readyTasks &= ~task->bit;
+  SREG = oldSREG;
+
+  #if SCHEDULER_STATS == 1
+  unsigned long latency = micros() - task->readySince;
+  if (latency > 0xFFFF) {
+    latency = 0xFFFF;
+  }
+  stats.latencyTotal += latency;
+  if (latency > stats.latencyMax) {
+    stats.latencyMax = latency;
+  }
+  stats.runs++;
+  #endif
+
+  task->run(task);
+}
+
+bool schedulerIdle(void) {
+  return readyTasks == 0 && !timersPending();
+}
+
+void schedulerStats(SchedulerStats *copy) {
+  #if SCHEDULER_STATS == 1
+  *copy = stats;
+  copy->awakeMillis = millis() - statsSince - stats.sleptMillis;
+  #else
+  memset(copy, 0, sizeof(SchedulerStats));
+  #endif
+}
+
+void schedulerStatsClear(void) {
+  #if SCHEDULER_STATS == 1
+  memset(&stats, 0, sizeof(stats));
+  sleptMicros = 0;
+  statsSince = millis();
+  #endif
+}
+
+void schedulerStatsPrint(void) {
+  SchedulerStats copy;
+  schedulerStats(&copy);
+  uint32_t total = copy.sleptMillis + copy.awakeMillis;
+  Serial.print("Unessa ");
+  Serial.print(total > 0 ? (uint32_t)(copy.sleptMillis * 100ULL / total) : 0);
+  Serial.print(" % ajasta (");
+  Serial.print(copy.sleptMillis);
+  Serial.print(" / ");
+  Serial.print(total);
+  Serial.print(" ms), heräämisiä ");
+  Serial.print(copy.sleeps);
+  Serial.print(", taskeja ajettu ");
+  Serial.print(copy.runs);
+  Serial.print(", viive herätyksestä ajoon keskim. ");
+  Serial.print(copy.runs > 0 ? copy.latencyTotal / copy.runs : 0);
+  Serial.print(" us, max ");
+  Serial.print(copy.latencyMax);
+  Serial.println(" us");
+}
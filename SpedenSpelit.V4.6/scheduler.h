@@ -0,0 +1,130 @@
+/*
+A small cooperative scheduler. Every module that used to be polled from the loop is a task that only runs when something
+has woken it up: an interrupt or another task calling taskWake(), or a deadline set with PT_SLEEP() running out.
+
+Tasks are protothreads, stackless coroutines written as one function that returns whenever it has to wait and continues
+from the same place the next time it's run. Local variables don't survive a wait, keep state in static variables instead.
+Only one PT_ macro can be used per line (they use __LINE__ to mark the place to continue from).
+
+Each task has its own priority (0-7, 0 is the most urgent) and is a bit in the ready mask. schedulerRun() runs one step of
+the most urgent ready task and returns, so a woken task never waits longer than the longest single step of another task.
+Keep the steps short and wait instead of looping.
+
+When nothing is ready schedulerRun() puts the MCU to idle sleep. Any interrupt wakes it (pin change, the Timer1 tick, UART,
+and also the Timer0 millis() tick and Timer2 while sound or led fades are on), and waking from idle takes only a few clock
+cycles. How long a woken task waits before it runs is measured and can be printed with schedulerStatsPrint().
+
+HOW TO USE:
+  1. Call initializeTimers() and initializeScheduler() in setup (deadlines use the timer wheel) and place schedulerRun(); in
+     the loop function
+  2. Write the task:
+       uint8_t myTaskRun(Task *task) {
+         PT_BEGIN(task);
+         for (;;) {
+           PT_WAIT_UNTIL(task, somethingHappened);
+           ...
+           PT_SLEEP(task, 10);
+         }
+         PT_END(task);
+       }
+  3. Create it and add it: Task myTask = { &myTaskRun }; taskAdd(&myTask, PRIORITY_MYTASK);
+  4. Whatever changes somethingHappened calls taskWake(&myTask) (also fine from an interrupt)
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include <arduino.h>
+
+// Task priorities, 0 runs first. Each priority can hold one task
+#define PRIORITY_BUTTONS 0
+#define PRIORITY_LCD 1
+#define PRIORITY_REPLAY 2
+#define PRIORITY_SERIAL 3
+#define PRIORITY_RAM 4
+#define PRIORITY_BOOT 5
+#define TASK_SLOTS 8
+
+// 1 = sleep when there is nothing to do, 0 = spin in the loop
+#define SCHEDULER_SLEEP 1
+// 1 = keep sleep and wake-up latency statistics, 0 = don't (taskWake() gets a little faster)
+#define SCHEDULER_STATS 1
+
+// What a task function returns
+#define TASK_WAITING 0
+#define TASK_ENDED 1
+
+struct Task {
+  uint8_t (*run)(Task *task);
+  // The rest is used by the scheduler
+  uint16_t resumeLine;
+  uint32_t wakeTime;
+  uint8_t bit;
+  volatile bool sleeping;
+  uint32_t readySince;
+};
+
+struct SchedulerStats {
+  uint32_t sleeps;        // times the MCU went to sleep (= wake-ups)
+  uint32_t sleptMillis;   // time spent asleep
+  uint32_t awakeMillis;   // time spent awake
+  uint32_t runs;          // task steps run
+  uint32_t latencyTotal;  // sum of the times tasks waited between being woken and running, microseconds
+  uint16_t latencyMax;    // the longest such wait, microseconds
+};
+
+// Protothread macros, see the example above
+#define PT_BEGIN(task) switch ((task)->resumeLine) { case 0:
+// Returns from the task until condition is true, the condition is checked again each time the task is woken
+#define PT_WAIT_UNTIL(task, condition) do { (task)->resumeLine = __LINE__; case __LINE__: if (!(condition)) return TASK_WAITING; } while (0)
+// Returns from the task until the next taskWake()
+#define PT_WAIT_EVENT(task) do { (task)->resumeLine = __LINE__; return TASK_WAITING; case __LINE__:; } while (0)
+// Lets other ready tasks run and continues after them
+#define PT_YIELD(task) do { (task)->resumeLine = __LINE__; taskWake(task); return TASK_WAITING; case __LINE__:; } while (0)
+// Waits for ms milliseconds, wakes in between are ignored
+#define PT_SLEEP(task, ms) do { taskSleep(task, ms); PT_WAIT_UNTIL(task, !(task)->sleeping); } while (0)
+// An ended task starts from the top the next time it's woken
+#define PT_END(task) } (task)->resumeLine = 0; return TASK_ENDED
+
+/*
+Turns off the parts of the chip the game doesn't use (ADC, analog comparator, TWI) to save power, and clears the statistics
+*/
+void initializeScheduler(void);
+
+/*
+Adds a task with the given priority and makes it ready so it runs up to its first wait. Adding a task that is already
+there does nothing
+*/
+void taskAdd(Task *task, uint8_t priority);
+
+/*
+Marks the task ready to run. Can be called from interrupts
+*/
+void taskWake(Task *task);
+
+/*
+Sets the task to wake after ms milliseconds (used by PT_SLEEP)
+*/
+void taskSleep(Task *task, uint16_t ms);
+
+/*
+Function placed in the .ino's loop. Runs deferred timers (timers.h) and one step of the most urgent ready task
+*/
+void schedulerRun(void);
+
+/*
+True when no task is ready and no deferred timer is waiting, nothing will happen before the next interrupt
+*/
+bool schedulerIdle(void);
+
+/*
+Copies the statistics gathered since the last schedulerStatsClear()
+*/
+void schedulerStats(SchedulerStats *stats);
+void schedulerStatsClear(void);
+
+/*
+Prints the statistics over Serial in one line
+*/
+void schedulerStatsPrint(void);
+
+#endif
@@ -0,0 +1,131 @@
+#include "settings.h"
+#include "replay.h"
+#include <EEPROM.h>
+
+Settings settings;
+
+// Layout: marker, the Settings bytes, checksum. A new marker for a changed Settings keeps old boxes from misreading it
+const uint8_t settingsMarker = 'S';
+const int settingsSize = sizeof(Settings) + 2;
+static_assert(SETTINGS_EEPROM_ADDRESS + settingsSize <= REPLAY_EEPROM_ADDRESS, "the settings run into the saved replay");
+
+// The next byte settingsCheck() compares, settingsSize when everything is written. settingsAddScore() restarts the save
+// from the game's timer interrupt, so it's only read and moved on with interrupts off
+static volatile int savePosition = settingsSize;
+
+static uint8_t checksum(const uint8_t *bytes) {
+  uint8_t sum = 0x5A;
+  for (uint8_t i = 0; i < sizeof(Settings); i++) {
+    sum = (sum << 1 | sum >> 7) ^ bytes[i];
+  }
+  return sum;
+}
+
+/*
+The byte that belongs at the given position of the layout
+*/
+static uint8_t layoutByte(int position) {
+  const uint8_t *bytes = (const uint8_t *)&settings;
+  if (position == 0) {
+    return settingsMarker;
+  }
+  if (position <= (int)sizeof(Settings)) {
+    return bytes[position - 1];
+  }
+  return checksum(bytes);
+}
+
+void settingsDefaults(void) {
+  settings.curve = 0;
+  settings.players = 1;
+  settings.debounce = 100;
+  settings.seed = 0;
+  for (uint8_t i = 0; i < SETTINGS_HIGH_SCORES; i++) {
+    settings.highScores[i] = 0;
+  }
+}
+
+bool settingsLoad(void) {
+  settingsDefaults();
+  if (EEPROM.read(SETTINGS_EEPROM_ADDRESS) != settingsMarker) {
+    return false;
+  }
+  Settings stored;
+  uint8_t *bytes = (uint8_t *)&stored;
+  for (uint8_t i = 0; i < sizeof(Settings); i++) {
+    bytes[i] = EEPROM.read(SETTINGS_EEPROM_ADDRESS + 1 + i);
+  }
+  if (EEPROM.read(SETTINGS_EEPROM_ADDRESS + settingsSize - 1) != checksum(bytes)) {
+    return false;
+  }
+  settings = stored;
+  return true;
+}
+
+void settingsSave(void) {
+  savePosition = 0;
+}
+
+void settingsCheck(void) {
+  // The checksum goes last, so a reset in the middle of a save leaves settings that fail the check and fall back to the
+  // defaults. A change made during a save starts it over
+  for (;;) {
+    if (!eeprom_is_ready()) {
+      return;
+    }
+    uint8_t oldSREG = SREG;
+    cli();
+    int position = savePosition;
+    if (position >= settingsSize) {
+      SREG = oldSREG;
+      return;
+    }
+    uint8_t data = layoutByte(position);
+    savePosition = position + 1;
+    SREG = oldSREG;
+    int address = SETTINGS_EEPROM_ADDRESS + position;
+    if (EEPROM.read(address) != data) {
+      EEPROM.write(address, data);
+      return;
+    }
+  }
+}
+
+uint8_t settingsAddScore(uint16_t score) {
+  if (score == 0) {
+    return 0;
+  }
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t place = 0; place < SETTINGS_HIGH_SCORES; place++) {
+    if (score > settings.highScores[place]) {
+      for (uint8_t i = SETTINGS_HIGH_SCORES - 1; i > place; i--) {
+        settings.highScores[i] = settings.highScores[i - 1];
+      }
+      settings.highScores[place] = score;
+      settingsSave();
+      SREG = oldSREG;
+      return place + 1;
+    }
+  }
+  SREG = oldSREG;
+  return 0;
+}
+
+void settingsClearScores(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  for (uint8_t i = 0; i < SETTINGS_HIGH_SCORES; i++) {
+    settings.highScores[i] = 0;
+  }
+  settingsSave();
+  SREG = oldSREG;
+}
+
+Settings settingsCopy(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  Settings copy = settings;
+  SREG = oldSREG;
+  return copy;
+}
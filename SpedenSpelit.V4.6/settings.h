@@ -0,0 +1,66 @@
+/*
+Settings that stay over a power cut: the speed curve, one or two players, the button debounce time, a fixed seed and the
+high score table. They live in the EEPROM bytes below REPLAY_EEPROM_ADDRESS (replay.h), behind a marker and a checksum,
+so a new board or a changed layout starts from the defaults instead of garbage.
+
+Writing an EEPROM byte takes 3.3 ms, which the game can't wait for. settingsSave() only marks the settings changed, and
+settingsCheck() writes at most one changed byte per call, when the EEPROM isn't busy with the previous one.
+
+HOW TO USE:
+  1. settingsLoad() once at startup, then read and change the fields of settings as needed
+  2. settingsSave() after a change, and call settingsCheck() regularly (e.g. from a slow task) to get it written
+*/
+
+#ifndef SETTINGS_H
+#define SETTINGS_H
+#include <arduino.h>
+
+// How many of the best scores are kept
+#define SETTINGS_HIGH_SCORES 5
+// Where the settings start in the EEPROM
+#define SETTINGS_EEPROM_ADDRESS 0
+
+struct Settings {
+  uint8_t curve;      // speed curve number, 0 = fixed, 1 = adaptive (gameCurves[] in the .ino)
+  uint8_t players;    // 1 or 2
+  uint8_t debounce;   // ms, see setButtonDebounce() (buttons.h)
+  uint32_t seed;      // 0 = a new seed every game
+  uint16_t highScores[SETTINGS_HIGH_SCORES];  // best first, 0 = empty
+};
+
+extern Settings settings;
+
+/*
+Reads the settings from the EEPROM. Returns false (and leaves the defaults in settings) if there are none or they're broken
+*/
+bool settingsLoad(void);
+
+void settingsDefaults(void);
+
+/*
+Marks the settings to be written by settingsCheck()
+*/
+void settingsSave(void);
+
+/*
+Writes the next changed byte, if any and the EEPROM is ready. Never waits
+*/
+void settingsCheck(void);
+
+/*
+Puts a finished game's score in the high score table. Returns its place (1 = best) or 0 if it didn't make it. The game ends
+in its timer interrupt, so this is called from there, and the table only changes with interrupts off
+*/
+uint8_t settingsAddScore(uint16_t score);
+
+/*
+Empties the high score table, with interrupts off so a game ending at the same time can't leave it half shifted
+*/
+void settingsClearScores(void);
+
+/*
+A copy of the settings taken with interrupts off, for reading the high scores (or anything else) outside of interrupts
+*/
+Settings settingsCopy(void);
+
+#endif
@@ -0,0 +1,200 @@
+#include "timers.h"
+#include "TimerOne.h"
+
+/*
+The wheel has two levels of 64 slots. Level 0 has a slot for each of the next 64 ms, level 1 a slot for each of the next
+64 blocks of 64 ms (about 4 s). Every 64 ms the next level 1 slot is emptied into level 0 ("cascade"). A timer further away
+than level 1 reaches is parked in the last level 1 slot and sorted again when that slot cascades.
+Each slot is a doubly linked list (pprev points at whatever points to the timer), so a timer is added or removed without
+looking at the others.
+*/
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+
+SoftTimer *wheel0[WHEEL_SIZE];
+SoftTimer *wheel1[WHEEL_SIZE];
+volatile uint32_t wheelNow = 0;
+
+// Deferred timers that have fired, in firing order, waiting for timersRun()
+SoftTimer *pendingHead = 0;
+SoftTimer *pendingTail = 0;
+
+static void timersTick();
+
+void initializeTimers(void) {
+  for (int i = 0; i < WHEEL_SIZE; i++) {
+    wheel0[i] = 0;
+    wheel1[i] = 0;
+  }
+  wheelNow = 0;
+  pendingHead = 0;
+  pendingTail = 0;
+
+  Timer1.initialize(1000);
+  Timer1.attachInterrupt(&timersTick, 1000);
+}
+
+/*
+Links a timer into the slot its expiry time belongs to. Call with interrupts disabled
+*/
+static void wheelInsert(SoftTimer *timer) {
+  uint32_t delta = timer->expires - wheelNow;
+  SoftTimer **slot;
+  if (delta < WHEEL_SIZE) {
+    slot = &wheel0[timer->expires & WHEEL_MASK];
+  }
+  else if (delta < (uint32_t)WHEEL_SIZE * WHEEL_SIZE) {
+    slot = &wheel1[(timer->expires >> WHEEL_BITS) & WHEEL_MASK];
+  }
+  else {
+    // The current block's slot is the last one to cascade again
+    slot = &wheel1[(wheelNow >> WHEEL_BITS) & WHEEL_MASK];
+  }
+
+  timer->next = *slot;
+  if (timer->next != 0) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = slot;
+  *slot = timer;
+}
+
+// Call with interrupts disabled
+static void wheelRemove(SoftTimer *timer) {
+  if (timer->pprev == 0) {
+    return;
+  }
+  *timer->pprev = timer->next;
+  if (timer->next != 0) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = 0;
+  timer->pprev = 0;
+}
+
+/*
+Takes the whole list out of a slot into a local head, so callbacks can start and cancel timers while it's being handled
+*/
+static SoftTimer *detachSlot(SoftTimer **slot, SoftTimer **head) {
+  *head = *slot;
+  *slot = 0;
+  if (*head != 0) {
+    (*head)->pprev = head;
+  }
+  return *head;
+}
+
+static void timersTick() {
+  wheelNow++;
+  uint32_t now = wheelNow;
+
+  if ((now & WHEEL_MASK) == 0) {
+    SoftTimer *cascade;
+    detachSlot(&wheel1[(now >> WHEEL_BITS) & WHEEL_MASK], &cascade);
+    while (cascade != 0) {
+      SoftTimer *timer = cascade;
+      wheelRemove(timer);
+      wheelInsert(timer);
+    }
+  }
+
+  SoftTimer *expired;
+  detachSlot(&wheel0[now & WHEEL_MASK], &expired);
+  while (expired != 0) {
+    SoftTimer *timer = expired;
+    wheelRemove(timer);
+    if (timer->period != 0) {
+      timer->expires += timer->period;
+      wheelInsert(timer);
+    }
+
+    if (timer->mode == TIMER_ISR) {
+      timer->callback();
+    }
+    else {
+      timer->pending = true;
+      if (!timer->queued) {
+        timer->queued = true;
+        timer->nextPending = 0;
+        if (pendingTail != 0) {
+          pendingTail->nextPending = timer;
+        }
+        else {
+          pendingHead = timer;
+        }
+        pendingTail = timer;
+      }
+    }
+  }
+}
+
+void timerStart(SoftTimer *timer, uint16_t delay, uint16_t period) {
+  uint8_t oldSREG = SREG;
+  cli();
+  wheelRemove(timer);
+  // The slot of the current millisecond has already been handled
+  if (delay == 0) {
+    delay = 1;
+  }
+  timer->expires = wheelNow + delay;
+  timer->period = period;
+  wheelInsert(timer);
+  SREG = oldSREG;
+}
+
+void timerSetPeriod(SoftTimer *timer, uint16_t period) {
+  uint8_t oldSREG = SREG;
+  cli();
+  timer->period = period;
+  SREG = oldSREG;
+}
+
+void timerCancel(SoftTimer *timer) {
+  uint8_t oldSREG = SREG;
+  cli();
+  wheelRemove(timer);
+  // A call already waiting in the queue is skipped by timersRun()
+  timer->pending = false;
+  SREG = oldSREG;
+}
+
+bool timerActive(SoftTimer *timer) {
+  return timer->pprev != 0 || timer->pending;
+}
+
+uint32_t timersNow(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  uint32_t now = wheelNow;
+  SREG = oldSREG;
+  return now;
+}
+
+bool timersPending(void) {
+  return pendingHead != 0;
+}
+
+void timersRun(void) {
+  while (true) {
+    uint8_t oldSREG = SREG;
+    cli();
+    SoftTimer *timer = pendingHead;
+    if (timer == 0) {
+      SREG = oldSREG;
+      return;
+    }
+    pendingHead = timer->nextPending;
+    if (pendingHead == 0) {
+      pendingTail = 0;
+    }
+    timer->queued = false;
+    bool run = timer->pending;
+    timer->pending = false;
+    SREG = oldSREG;
+
+    if (run) {
+      timer->callback();
+    }
+  }
+}
@@ -0,0 +1,76 @@
+/*
+Software timers multiplexed onto Timer1. Timer1 gives a 1 ms tick, and any number of one-shot or periodic timers hang off it
+in a two-level timer wheel, so starting and cancelling a timer takes the same time however many there are.
+
+A timer's callback runs either straight from the tick interrupt (TIMER_ISR, at most 1 ms late) or from timersRun() in the
+loop (TIMER_DEFERRED, at most 1 ms plus one loop iteration late). Deferred callbacks can take their time, interrupt ones
+should be short.
+
+HOW TO USE:
+  1. Call initializeTimers() in setup and place timersRun(); in the loop function
+  2. Create a timer: SoftTimer myTimer = { &myCallback, TIMER_DEFERRED };
+  3. timerStart(&myTimer, delay, period) - first call after delay ms, then every period ms (0 = only once)
+  4. timerSetPeriod(&myTimer, period) changes the period without moving the next call, timerCancel(&myTimer) stops it
+*/
+
+#ifndef TIMERS_H
+#define TIMERS_H
+#include <arduino.h>
+
+#define TIMER_DEFERRED 0
+#define TIMER_ISR 1
+
+struct SoftTimer {
+  void (*callback)();
+  uint8_t mode;
+  // The rest is used by the wheel
+  SoftTimer *next;
+  SoftTimer **pprev;
+  SoftTimer *nextPending;
+  uint32_t expires;
+  uint16_t period;
+  bool queued;
+  bool pending;
+};
+
+/*
+Sets Timer1 to tick once a millisecond and clears the wheel
+*/
+void initializeTimers(void);
+
+/*
+Starts (or restarts) a timer. delay and period are in milliseconds, period 0 makes a one-shot timer
+*/
+void timerStart(SoftTimer *timer, uint16_t delay, uint16_t period);
+
+/*
+Changes the period of a periodic timer from its next re-arm on, the call already waiting keeps its time
+*/
+void timerSetPeriod(SoftTimer *timer, uint16_t period);
+
+/*
+Stops a timer, also drops a deferred call that hasn't been run yet
+*/
+void timerCancel(SoftTimer *timer);
+
+/*
+True if the timer is running or its deferred callback is waiting for timersRun()
+*/
+bool timerActive(SoftTimer *timer);
+
+/*
+Milliseconds counted by the wheel since initializeTimers()
+*/
+uint32_t timersNow(void);
+
+/*
+True if a deferred timer has fired and is waiting for timersRun()
+*/
+bool timersPending(void);
+
+/*
+Function placed in the .ino's loop (or schedulerRun(), scheduler.h). Runs the callbacks of deferred timers that have fired
+*/
+void timersRun(void);
+
+#endif
@@ -0,0 +1,451 @@
+/*
+Reads Serial captures of the boxes, any size and any number of them, and sums up how people actually play: reaction time
+percentiles per speed level, how often each button is missed and how far behind players were when they lost.
+
+Every game is found from its "REPLAY <hex>" line (replay.h, printed with 'd' or REPLAY_SERIAL) and played back through
+game.cpp, the rules the box runs, so a hit, a speed-up and a loss mean exactly what they meant in buttonPress(),
+checkGame() and lostTheGame(). Other lines are skipped, as are "REPLAY_TAIL" and "REPLAY_HEAD" lines whose start or
+end is missing and recordings that don't end with the score the rules give.
+
+Times come from the stream as the box kept them: a press is milliseconds after the previous event, a tick comes a period
+after the previous tick (the period in force when that tick re-armed the timer), and after a speed-up on the fixed curve
+the tick restarts from the press (initializeTimer()). Adaptive games (a curve event after the header) change the period
+on almost every hit without moving the tick, and their speed levels are the milestones every stepHits hits. The
+reaction time of a press is from when its target was lit to the press.
+
+The files are memory-mapped and cut into 64 MB pieces that the threads take one at a time, each thread keeping its own
+fixed-size histograms. Memory stays the same whatever the size of the logs, and the results are integer sums that come
+out the same for any thread count.
+
+HOW TO USE (in host/analytics):
+  g++ -std=gnu++11 -O2 -pthread -I../emulator -I../../SpedenSpelit.V4.6 analytics.cpp \
+    ../../SpedenSpelit.V4.6/game.cpp -o /tmp/spede-analytics
+  /tmp/spede-analytics [-j threads] capture.log...
+*/
+
+#include <arduino.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "game.h"
+
+// Reaction times in 1 ms buckets up to this, speed levels (speed-ups so far) up to the last one
+const uint32_t reactionBuckets = 4000;
+const uint32_t levels = 24;
+const uint32_t scoreBuckets = 1000;
+// Replay buttons are 4 bits
+const uint32_t buttons = 16;
+const size_t pieceSize = 64 << 20;
+
+struct Stats {
+  uint64_t lines = 0, games = 0, tails = 0, heads = 0, broken = 0, bytes = 0;
+  uint64_t reactions[levels][reactionBuckets + 1] = {};
+  uint64_t reactionSums[levels] = {};
+  uint32_t levelPeriods[levels] = {};
+  uint64_t targetPresses[buttons] = {}, targetMisses[buttons] = {};
+  // How many targets were waiting when the game was lost, by falling behind or by a wrong button
+  uint64_t lagAtLoss[GAME_HISTORY + 1] = {};
+  uint64_t lostBehind = 0, lostWrong = 0;
+  uint64_t scores[scoreBuckets + 1] = {};
+
+  void add(const Stats &other) {
+    lines += other.lines;
+    games += other.games;
+    tails += other.tails;
+    heads += other.heads;
+    broken += other.broken;
+    bytes += other.bytes;
+    for (uint32_t level = 0; level < levels; level++) {
+      for (uint32_t i = 0; i <= reactionBuckets; i++) {
+        reactions[level][i] += other.reactions[level][i];
+      }
+      reactionSums[level] += other.reactionSums[level];
+      if (levelPeriods[level] == 0) {
+        levelPeriods[level] = other.levelPeriods[level];
+      }
+    }
+    for (uint32_t i = 0; i < buttons; i++) {
+      targetPresses[i] += other.targetPresses[i];
+      targetMisses[i] += other.targetMisses[i];
+    }
+    for (uint32_t i = 0; i <= GAME_HISTORY; i++) {
+      lagAtLoss[i] += other.lagAtLoss[i];
+    }
+    lostBehind += other.lostBehind;
+    lostWrong += other.lostWrong;
+    for (uint32_t i = 0; i <= scoreBuckets; i++) {
+      scores[i] += other.scores[i];
+    }
+  }
+};
+
+/*
+The part of a game that's only added to the totals if the whole recording checks out
+*/
+struct GameStats {
+  std::vector<std::pair<uint8_t, uint32_t>> reactions;   // level, ms
+  std::vector<std::pair<uint8_t, bool>> targets;         // button, missed
+  uint32_t periods[levels];
+  uint8_t level;
+};
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+bool getVarint(const std::vector<uint8_t> &bytes, size_t &position, uint32_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; position < bytes.size() && shift < 35; shift += 7) {
+    uint8_t data = bytes[position++];
+    value |= (uint32_t)(data & 0x7F) << shift;
+    if (!(data & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The tick period in whole milliseconds like initializeTimer() gives it to the timer wheel
+uint32_t tickPeriod(long period) {
+  return (period + 500) / 1000;
+}
+
+/*
+Plays one recording back through the rules. Returns false if it doesn't hold together
+*/
+bool playRecording(const std::vector<uint8_t> &bytes, Stats &stats, GameStats &game) {
+  if (bytes.size() < 5) {
+    return false;
+  }
+  size_t position = 4;
+  uint32_t value;
+  if (!getVarint(bytes, position, value) || value == 0) {
+    return false;
+  }
+  long startPeriod = value;
+  // The curve number follows the header when it isn't the fixed curve (the numbers of gameCurves[] in the .ino)
+  GameCurve curve = gameCurve;
+  size_t afterHeader = position;
+  if (getVarint(bytes, position, value) && (value & 7) == 7) {
+    if ((value >> 3) != 1) {
+      return false;
+    }
+    curve = adaptiveCurve;
+  }
+  else {
+    position = afterHeader;
+  }
+  curve.startPeriod = startPeriod;
+  bool adaptive = curve.targetLag > 0;
+  GameState state;
+  gameReset(&state, &curve);
+
+  game.reactions.clear();
+  game.targets.clear();
+  uint8_t &level = game.level;
+  level = 0;
+  game.periods[0] = tickPeriod(state.period);
+  uint32_t lastEvent = 0, lastTick = 0;
+  // The period the timer was re-armed with at the last tick, and whether the last press changed the period
+  uint32_t armed = tickPeriod(state.period);
+  bool changed = false;
+  // When the waiting targets were lit, oldest at litHead
+  uint32_t lit[GAME_HISTORY];
+  uint8_t litHead = 0;
+
+  while (getVarint(bytes, position, value)) {
+    if ((value & 1) == 0) {
+      uint32_t now = lastEvent + (value >> 5);
+      int8_t button = (value >> 1) & 0x0F;
+      uint8_t waiting = state.waiting;
+      int8_t target = waiting > 0 ? state.targets[waiting - 1] : -1;
+      long oldPeriod = state.period;
+      uint8_t result = gamePress(&state, button, std::min<uint32_t>(value >> 5, 0xFFFF));
+      if (target >= 0) {
+        game.targets.push_back({ (uint8_t)target, result == GAME_MISS });
+      }
+      if (result == GAME_MISS) {
+        // The rules lose the game here, the next event has to be the end
+        if (!getVarint(bytes, position, value) || (value & 7) != 5 || (value >> 3) != state.score) {
+          return false;
+        }
+        stats.lostWrong++;
+        stats.lagAtLoss[waiting]++;
+        stats.scores[std::min<uint32_t>(state.score, scoreBuckets)]++;
+        return true;
+      }
+      game.reactions.push_back({ level, now - lit[litHead] });
+      litHead = (litHead + 1) % GAME_HISTORY;
+      lastEvent = now;
+      changed = state.period != oldPeriod;
+      if (changed && !adaptive) {
+        // The box restarts the tick from this press with the new period, which comes in the next event
+        lastTick = now;
+      }
+      if (result == GAME_SPEEDUP) {
+        if (level < levels - 1) {
+          level++;
+        }
+        game.periods[level] = tickPeriod(state.period);
+      }
+    }
+    else if ((value & 7) == 1) {
+      uint32_t now = lastTick + armed;
+      lastTick = now;
+      lastEvent = now;
+      armed = tickPeriod(state.period);
+      changed = false;
+      if (gameTick(&state, value >> 3)) {
+        if (!getVarint(bytes, position, value) || (value & 7) != 5 || (value >> 3) != state.score) {
+          return false;
+        }
+        stats.lostBehind++;
+        stats.lagAtLoss[GAME_HISTORY]++;
+        stats.scores[std::min<uint32_t>(state.score, scoreBuckets)]++;
+        return true;
+      }
+      lit[(litHead + state.waiting - 1) % GAME_HISTORY] = now;
+    }
+    else if ((value & 7) == 3) {
+      // Only right after a press that changed the period. On the fixed curve older firmware rounded the period
+      // differently, so the box's value is taken. Adaptive games don't record their periods anymore, the rules work
+      // them out, but the ones that do have to match the rules exactly
+      if (!changed || (adaptive && (long)(value >> 3) != state.period)) {
+        return false;
+      }
+      changed = false;
+      state.period = value >> 3;
+      if (!adaptive) {
+        armed = tickPeriod(state.period);
+        game.periods[level] = armed;
+      }
+    }
+    else {
+      // The recording ended without the rules losing the game
+      return false;
+    }
+  }
+  return false;
+}
+
+void processLine(const char *line, const char *end, Stats &stats, std::vector<uint8_t> &bytes, GameStats &game) {
+  stats.lines++;
+  static const char replay[] = "REPLAY ", tail[] = "REPLAY_TAIL ", head[] = "REPLAY_HEAD ";
+  if ((size_t)(end - line) >= sizeof(tail) - 1 && memcmp(line, tail, sizeof(tail) - 1) == 0) {
+    stats.tails++;
+    return;
+  }
+  if ((size_t)(end - line) >= sizeof(head) - 1 && memcmp(line, head, sizeof(head) - 1) == 0) {
+    stats.heads++;
+    return;
+  }
+  if ((size_t)(end - line) < sizeof(replay) - 1 || memcmp(line, replay, sizeof(replay) - 1) != 0) {
+    return;
+  }
+  bytes.clear();
+  for (const char *c = line + sizeof(replay) - 1; c + 1 < end; c += 2) {
+    int high = hexValue(c[0]), low = hexValue(c[1]);
+    if (high < 0 || low < 0) {
+      break;
+    }
+    bytes.push_back((high << 4) | low);
+  }
+
+  // The loss and the score are only counted once the recording has checked out, the rest is added here
+  if (!playRecording(bytes, stats, game)) {
+    stats.broken++;
+    return;
+  }
+  stats.games++;
+  for (auto &reaction : game.reactions) {
+    stats.reactions[reaction.first][std::min<uint32_t>(reaction.second, reactionBuckets)]++;
+    stats.reactionSums[reaction.first] += reaction.second;
+  }
+  for (auto &target : game.targets) {
+    stats.targetPresses[target.first]++;
+    stats.targetMisses[target.first] += target.second;
+  }
+  for (uint32_t level = 0; level <= game.level; level++) {
+    if (stats.levelPeriods[level] == 0) {
+      stats.levelPeriods[level] = game.periods[level];
+    }
+  }
+}
+
+struct Piece {
+  const char *data;
+  size_t size;
+  size_t start, end;
+};
+
+/*
+Handles the lines that start inside [start, end) of a file. A line that crosses end belongs to this piece, so the next
+piece skips to the first line that starts in it
+*/
+void processPiece(const Piece &piece, Stats &stats, std::vector<uint8_t> &bytes, GameStats &game) {
+  const char *data = piece.data, *fileEnd = piece.data + piece.size;
+  const char *line = data + piece.start;
+  if (piece.start > 0) {
+    const char *newline = (const char *)memchr(line - 1, '\n', fileEnd - (line - 1));
+    line = newline == 0 ? fileEnd : newline + 1;
+  }
+  while (line < data + piece.end) {
+    const char *newline = (const char *)memchr(line, '\n', fileEnd - line);
+    const char *end = newline == 0 ? fileEnd : newline;
+    const char *text = end;
+    while (text > line && (text[-1] == '\r' || text[-1] == ' ')) {
+      text--;
+    }
+    processLine(line, text, stats, bytes, game);
+    line = end + 1;
+  }
+  stats.bytes += piece.end - piece.start;
+}
+
+uint32_t percentile(const uint64_t *histogram, uint32_t buckets, uint64_t total, double share) {
+  uint64_t needed = std::max<uint64_t>(1, (uint64_t)(total * share + 0.999999));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < buckets; i++) {
+    seen += histogram[i];
+    if (seen >= needed) {
+      return i;
+    }
+  }
+  return buckets - 1;
+}
+
+void report(const Stats &stats, double seconds) {
+  printf("%llu lines, %.1f MB in %.2f s (%.0f MB/s), %llu games, %llu REPLAY_TAIL, %llu REPLAY_HEAD, %llu broken\n",
+    (unsigned long long)stats.lines, stats.bytes / 1e6, seconds, stats.bytes / 1e6 / std::max(seconds, 1e-6),
+    (unsigned long long)stats.games, (unsigned long long)stats.tails, (unsigned long long)stats.heads,
+    (unsigned long long)stats.broken);
+  if (stats.games == 0) {
+    return;
+  }
+
+  printf("\nReaction times (ms from the target lighting up to its press)\n");
+  printf("%5s %7s %9s %6s %5s %5s %5s %5s\n", "level", "tick", "presses", "mean", "p10", "p50", "p90", "p99");
+  for (uint32_t level = 0; level < levels; level++) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i <= reactionBuckets; i++) {
+      total += stats.reactions[level][i];
+    }
+    if (total == 0) {
+      continue;
+    }
+    printf("%4u%s %5ums %9llu %6.0f %5u %5u %5u %5u\n", level, level == levels - 1 ? "+" : " ", stats.levelPeriods[level],
+      (unsigned long long)total, (double)stats.reactionSums[level] / total,
+      percentile(stats.reactions[level], reactionBuckets + 1, total, 0.10),
+      percentile(stats.reactions[level], reactionBuckets + 1, total, 0.50),
+      percentile(stats.reactions[level], reactionBuckets + 1, total, 0.90),
+      percentile(stats.reactions[level], reactionBuckets + 1, total, 0.99));
+  }
+
+  printf("\nPresses per lit target button\n%6s %9s %7s %9s\n", "button", "presses", "misses", "miss rate");
+  for (uint32_t button = 0; button < buttons; button++) {
+    if (stats.targetPresses[button] == 0) {
+      continue;
+    }
+    printf("%6u %9llu %7llu %8.2f%%\n", button, (unsigned long long)stats.targetPresses[button],
+      (unsigned long long)stats.targetMisses[button], 100.0 * stats.targetMisses[button] / stats.targetPresses[button]);
+  }
+
+  printf("\nLosses: %llu wrong button, %llu fell %d behind\nTargets waiting at the loss:", (unsigned long long)stats.lostWrong,
+    (unsigned long long)stats.lostBehind, GAME_HISTORY);
+  for (uint32_t lag = 0; lag <= GAME_HISTORY; lag++) {
+    printf(" %u:%llu", lag, (unsigned long long)stats.lagAtLoss[lag]);
+  }
+  printf("\nScores: p10 %u, p50 %u, p90 %u, p99 %u\n", percentile(stats.scores, scoreBuckets + 1, stats.games, 0.10),
+    percentile(stats.scores, scoreBuckets + 1, stats.games, 0.50),
+    percentile(stats.scores, scoreBuckets + 1, stats.games, 0.90),
+    percentile(stats.scores, scoreBuckets + 1, stats.games, 0.99));
+}
+
+int main(int argc, char **argv) {
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int option;
+  while ((option = getopt(argc, argv, "j:")) != -1) {
+    if (option == 'j') {
+      threads = std::max(1ul, strtoul(optarg, 0, 10));
+    }
+    else {
+      fprintf(stderr, "usage: %s [-j threads] capture.log...\n", argv[0]);
+      return 2;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-j threads] capture.log...\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Piece> pieces;
+  std::vector<std::pair<void *, size_t>> mappings;
+  for (int i = optind; i < argc; i++) {
+    int file = open(argv[i], O_RDONLY);
+    struct stat info;
+    if (file < 0 || fstat(file, &info) != 0) {
+      fprintf(stderr, "can't read %s\n", argv[i]);
+      return 2;
+    }
+    if (info.st_size == 0) {
+      close(file);
+      continue;
+    }
+    void *data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "can't map %s\n", argv[i]);
+      return 2;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    mappings.push_back({ data, (size_t)info.st_size });
+    for (size_t start = 0; start < (size_t)info.st_size; start += pieceSize) {
+      pieces.push_back({ (const char *)data, (size_t)info.st_size, start,
+        std::min(start + pieceSize, (size_t)info.st_size) });
+    }
+  }
+
+  struct timespec began, ended;
+  clock_gettime(CLOCK_MONOTONIC, &began);
+  std::atomic<size_t> next(0);
+  std::vector<Stats *> partial(threads);
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < threads; i++) {
+    partial[i] = new Stats();
+    workers.emplace_back([&, i]() {
+      std::vector<uint8_t> bytes;
+      GameStats game;
+      for (size_t piece; (piece = next++) < pieces.size();) {
+        processPiece(pieces[piece], *partial[i], bytes, game);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &ended);
+
+  Stats *total = new Stats();
+  for (Stats *stats : partial) {
+    total->add(*stats);
+    delete stats;
+  }
+  report(*total, (ended.tv_sec - began.tv_sec) + (ended.tv_nsec - began.tv_nsec) / 1e9);
+  delete total;
+  for (auto &mapping : mappings) {
+    munmap(mapping.first, mapping.second);
+  }
+  return 0;
+}
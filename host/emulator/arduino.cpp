@@ -0,0 +1,138 @@
+#include "arduino.h"
+#include <stdio.h>
+
+uint64_t hostTime = 0;
+uint8_t hostOverheadCycles = 3;
+uint32_t hostRegisterWrites = 0;
+HostStatusRegister SREG;
+uint64_t hostInterruptsOffMax = 0;
+static uint64_t interruptsOffSince = 0;
+void (*hostPortListener)(char port, uint8_t portValue, uint8_t ddrValue) = 0;
+HostSerial Serial;
+
+// PORT, DDR and input levels of ports B, C and D
+static uint8_t portValues[3];
+static uint8_t ddrValues[3];
+static uint8_t inputLevels[3] = { 0xFF, 0xFF, 0xFF };
+
+HostRegister PORTB('B', HostRegister::PORT), PORTC('C', HostRegister::PORT), PORTD('D', HostRegister::PORT);
+HostRegister DDRB('B', HostRegister::DDR), DDRC('C', HostRegister::DDR), DDRD('D', HostRegister::DDR);
+HostRegister PINB('B', HostRegister::PIN), PINC('C', HostRegister::PIN), PIND('D', HostRegister::PIN);
+
+static uint8_t portIndex(char port) {
+  return port - 'B';
+}
+
+HostRegister::operator uint8_t() const {
+  uint8_t i = portIndex(port);
+  // in/sbic take a cycle
+  hostTime += hostCycle;
+  if (kind == PORT) {
+    return portValues[i];
+  }
+  if (kind == DDR) {
+    return ddrValues[i];
+  }
+  // Outputs read back what they drive, inputs what is outside
+  return (portValues[i] & ddrValues[i]) | (inputLevels[i] & ~ddrValues[i]);
+}
+
+HostRegister &HostRegister::operator=(uint8_t value) {
+  uint8_t i = portIndex(port);
+  hostTime += (2 + hostOverheadCycles) * hostCycle;
+  hostRegisterWrites++;
+  if (kind == PORT) {
+    portValues[i] = value;
+  }
+  else if (kind == DDR) {
+    ddrValues[i] = value;
+  }
+  else {
+    // Writing ones to PIN flips those PORT bits
+    portValues[i] ^= value;
+  }
+  if (hostPortListener != 0) {
+    hostPortListener(port, portValues[i], ddrValues[i]);
+  }
+  return *this;
+}
+
+// A constant single bit |= or &= is one sbi/cbi, so the read that comes with it is not charged separately
+HostRegister &HostRegister::operator|=(uint8_t value) {
+  uint8_t i = portIndex(port);
+  uint8_t current = kind == PORT ? portValues[i] : (kind == DDR ? ddrValues[i] : 0);
+  return *this = current | value;
+}
+
+HostRegister &HostRegister::operator&=(uint8_t value) {
+  uint8_t i = portIndex(port);
+  uint8_t current = kind == PORT ? portValues[i] : (kind == DDR ? ddrValues[i] : 0);
+  return *this = current & value;
+}
+
+HostStatusRegister &HostStatusRegister::operator=(uint8_t newValue) {
+  if ((value & 0x80) && !(newValue & 0x80)) {
+    interruptsOffSince = hostTime;
+  }
+  else if (!(value & 0x80) && (newValue & 0x80) && hostTime - interruptsOffSince > hostInterruptsOffMax) {
+    hostInterruptsOffMax = hostTime - interruptsOffSince;
+  }
+  value = newValue;
+  return *this;
+}
+
+void hostSetInputs(char port, uint8_t levels) {
+  inputLevels[portIndex(port)] = levels;
+}
+
+unsigned long micros() {
+  return (unsigned long)(hostTime / 1000000);
+}
+
+unsigned long millis() {
+  return (unsigned long)(hostTime / 1000000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostTime += (uint64_t)us * 1000000;
+}
+
+void delay(unsigned long ms) {
+  hostTime += (uint64_t)ms * 1000000000;
+}
+
+void hostAdvance(uint64_t picoseconds) {
+  hostTime += picoseconds;
+}
+
+void HostSerial::print(const char *text) {
+  fputs(text, stdout);
+}
+
+void HostSerial::print(char c) {
+  putchar(c);
+}
+
+void HostSerial::print(int value) {
+  printf("%d", value);
+}
+
+void HostSerial::print(unsigned int value) {
+  printf("%u", value);
+}
+
+void HostSerial::print(long value) {
+  printf("%ld", value);
+}
+
+void HostSerial::print(unsigned long value) {
+  printf("%lu", value);
+}
+
+void HostSerial::print(double value) {
+  printf("%.2f", value);
+}
+
+void HostSerial::println() {
+  putchar('\n');
+}
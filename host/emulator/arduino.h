@@ -0,0 +1,104 @@
+/*
+The part of the Arduino core the display and latency modules use, for building them on a PC. The sketch includes
+<arduino.h>, so this file takes its place when host/emulator is first on the include path.
+
+The I/O registers are objects: every write to a PORT, DDR or PIN register is passed to the emulator with the time it
+happened, and costs the cycles the AVR instruction would (sbi/cbi/out 2 cycles). Time only moves through those accesses
+and delayMicroseconds(), so micros() tells how long the code under test kept the pins busy.
+*/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#define F_CPU 16000000UL
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+// Virtual time in picoseconds (a 16 MHz cycle is 62500 ps)
+extern uint64_t hostTime;
+// Cycles added to every register write on top of the instruction itself, an estimate of the code around it (loop
+// counters, shifts, loads of volatile variables)
+extern uint8_t hostOverheadCycles;
+// Number of register writes so far
+extern uint32_t hostRegisterWrites;
+
+const uint64_t hostCycle = 1000000000000ULL / F_CPU;
+
+// Called after every register write with the port letter and the new PORT and DDR values of that port
+extern void (*hostPortListener)(char port, uint8_t portValue, uint8_t ddrValue);
+
+class HostRegister {
+  public:
+    enum Kind { PORT, DDR, PIN };
+
+    HostRegister(char port, Kind kind) : port(port), kind(kind) {}
+
+    operator uint8_t() const;
+    HostRegister &operator=(uint8_t value);
+    HostRegister &operator|=(uint8_t value);
+    HostRegister &operator&=(uint8_t value);
+
+  private:
+    char port;
+    Kind kind;
+};
+
+extern HostRegister PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PINB, PINC, PIND;
+
+// Levels of the pins that are inputs, 1 when nothing pulls them down
+void hostSetInputs(char port, uint8_t levels);
+
+// Interrupts never come on the host, but the status register keeps track of how long the code under test has them off
+// (on the board the audio and led sample interrupt comes every 64 us, a longer stretch makes it miss one)
+class HostStatusRegister {
+  public:
+    operator uint8_t() const { return value; }
+    HostStatusRegister &operator=(uint8_t newValue);
+
+  private:
+    uint8_t value = 0x80;
+};
+
+extern HostStatusRegister SREG;
+// The longest stretch with interrupts off so far, picoseconds
+extern uint64_t hostInterruptsOffMax;
+inline void cli() { SREG = SREG & 0x7F; }
+inline void sei() { SREG = SREG | 0x80; }
+
+unsigned long micros();
+unsigned long millis();
+void delayMicroseconds(unsigned int us);
+void delay(unsigned long ms);
+
+// Moves the virtual time ahead, the emulator's way of letting time pass between calls
+void hostAdvance(uint64_t picoseconds);
+
+class HostSerial {
+  public:
+    void print(const char *text);
+    void print(char c);
+    void print(int value);
+    void print(unsigned int value);
+    void print(long value);
+    void print(unsigned long value);
+    void print(double value);
+    void println();
+    template <typename T> void println(T value) {
+      print(value);
+      println();
+    }
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,404 @@
+/*
+Runs the sketch's display.cpp and latency.cpp on a PC against emulated hardware: the five 74HC595s of the display chain and
+the HD44780 behind the last two of them. Plays a game the way the .ino drives the displays (boot, start, a press per tick
+with a message every tenth point, game over) and reports:
+  - how many register writes and how much CPU time each writeToSSeg(), gameMessage() and writeToLCD() costs, and how long
+    a message takes until its last character is on the screen
+  - every 74HC595 and HD44780 timing violation, and what the screens show at the end
+  - the longest time the display code kept interrupts off, against the 64 us of the audio and led sample interrupt
+  - the latency histogram of the presses (latency.h). The edge is marked right before writeToSSeg(), so it's the cost of the
+    display write only: the button scan, the 5 ms settle and the scheduler aren't emulated, and it isn't held to the budget
+and writes every pin into a VCD file for GTKWave.
+
+Time is counted per register access: a pin change costs its sbi/cbi (2 cycles at 16 MHz) plus -c cycles for the code
+around it, and waits cost what delayMicroseconds() was asked for. The pins are exact, edge for edge and in order, but the
+times are an estimate of the compiled code, not a cycle count of it.
+
+HOW TO USE (in host/emulator, -fpermissive like the Arduino build):
+  g++ -std=gnu++11 -O2 -fpermissive -I. -I../../SpedenSpelit.V4.6 *.cpp ../../SpedenSpelit.V4.6/display.cpp \
+    ../../SpedenSpelit.V4.6/latency.cpp -o /tmp/spede-emulator
+  /tmp/spede-emulator [-o trace.vcd] [-c overhead cycles] [-f LCD oscillator Hz] [-n presses]
+  gtkwave trace.vcd
+
+Exits with 1 if there was a timing violation or interrupts were off too long, so it can be run as a check.
+*/
+
+#include <arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include "display.h"
+#include "board.h"
+#include "latency.h"
+#include "hc595.h"
+#include "hd44780.h"
+#include "vcd.h"
+
+// Display with its layout constants in view
+class EmulatedDisplay : public Display {
+  public:
+    static const uint8_t chips = stpTotal;
+    static const uint8_t segmentChips = segmentDisplayAmount;
+};
+
+EmulatedDisplay display;
+Hc595Chain chain(EmulatedDisplay::chips);
+Hd44780 *lcd;
+VcdWriter vcd;
+
+// Timer2's sample interrupt (audio and led PWM) comes at 15625 Hz, interrupts kept off longer than that lose a sample
+const uint64_t interruptsOffBudget = 64000000ULL;
+
+// VCD signal numbers
+uint8_t serSignal, srclkSignal, rclkSignal, srclrSignal, oeSignal;
+uint8_t chipSignals[EmulatedDisplay::chips];
+uint8_t rsSignal, rwSignal, enableSignal, dataSignal, busySignal;
+// The busy line falls in the future, so it's written out once the time has got there
+uint64_t busyFalls = 0;
+
+uint8_t portValues[3], ddrValues[3];
+
+/*
+What one kind of call has cost over the run
+*/
+struct Cost {
+  std::string name;
+  uint32_t calls = 0;
+  uint32_t writes = 0, mostWrites = 0;
+  uint64_t cpu = 0, mostCpu = 0;
+  // LCD messages: from the call until the last character has been executed, and how many were replaced before that
+  uint32_t shown = 0, replaced = 0;
+  uint64_t screen = 0, mostScreen = 0;
+};
+
+// A deque keeps the pointers to its elements valid as it grows
+std::deque<Cost> costs;
+
+// The LCD message being written, the queue's work is counted to it
+struct Message {
+  Cost *cost;
+  uint64_t start;
+  uint32_t writes;
+  uint64_t cpu;
+};
+
+Message message = { 0, 0, 0, 0 };
+
+Cost *costOf(const char *name) {
+  for (Cost &cost : costs) {
+    if (cost.name == name) {
+      return &cost;
+    }
+  }
+  costs.push_back(Cost());
+  costs.back().name = name;
+  return &costs.back();
+}
+
+// Level of a pin as the outside sees it, inputs read as low (nothing drives the 74HC595 inputs)
+bool pinLevel(uint8_t pin) {
+  uint8_t port = pin < 8 ? 2 : (pin < 14 ? 0 : 1);
+  uint8_t bit = 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+  return portValues[port] & ddrValues[port] & bit;
+}
+
+void flushBusy(uint64_t time) {
+  if (busyFalls != 0 && busyFalls <= time) {
+    vcd.change(busyFalls, busySignal, 0);
+    busyFalls = 0;
+  }
+}
+
+/*
+Every register write ends up here: the Arduino pins go into the chain, and if that changes the outputs, they go on to
+the LCD
+*/
+void portChanged(char port, uint8_t portValue, uint8_t ddrValue) {
+  portValues[port - 'B'] = portValue;
+  ddrValues[port - 'B'] = ddrValue;
+
+  uint64_t time = hostTime;
+  flushBusy(time);
+  bool ser = pinLevel(stpSerialPin), srclk = pinLevel(stpSerialClockPin), rclk = pinLevel(stpRegisterClockPin);
+  bool srclr = pinLevel(stpSerialClearPin), oe = pinLevel(stpOutputEnablePin);
+  vcd.change(time, serSignal, ser);
+  vcd.change(time, srclkSignal, srclk);
+  vcd.change(time, rclkSignal, rclk);
+  vcd.change(time, srclrSignal, srclr);
+  vcd.change(time, oeSignal, oe);
+
+  if (!chain.setInputs(time, ser, srclk, rclk, srclr, oe)) {
+    return;
+  }
+  for (uint8_t chip = 0; chip < chain.length(); chip++) {
+    if (chain.outputsEnabled()) {
+      vcd.change(time, chipSignals[chip], chain.output(chip));
+    }
+    else {
+      vcd.release(time, chipSignals[chip]);
+    }
+  }
+
+  // Floating outputs read as low on the LCD side
+  uint8_t control = chain.outputsEnabled() ? chain.output(EmulatedDisplay::segmentChips) : 0;
+  uint8_t low = chain.outputsEnabled() ? chain.output(EmulatedDisplay::segmentChips + 1) : 0;
+  // registers[n] = [x][x][x][RS] [RW][E][D7][x], registers[n + 1] = [D6]...[D0][x]
+  bool rs = control & (1 << 4), rw = control & (1 << 3), e = control & (1 << 2);
+  uint8_t data = ((control & (1 << 1)) << 6) | (low >> 1);
+  bool wasBusy = lcd->busy(time);
+  lcd->setPins(time, rs, rw, e, data);
+  vcd.change(time, rsSignal, rs);
+  vcd.change(time, rwSignal, rw);
+  vcd.change(time, enableSignal, e);
+  vcd.change(time, dataSignal, data);
+  if (!wasBusy && lcd->busy(time)) {
+    vcd.change(time, busySignal, 1);
+    busyFalls = lcd->readyTime();
+  }
+}
+
+void count(Cost *cost, uint32_t writes, uint64_t cpu) {
+  cost->calls++;
+  cost->writes += writes;
+  cost->cpu += cpu;
+  if (writes > cost->mostWrites) {
+    cost->mostWrites = writes;
+  }
+  if (cpu > cost->mostCpu) {
+    cost->mostCpu = cpu;
+  }
+}
+
+void writeToSSeg(uint16_t score) {
+  uint64_t start = hostTime;
+  uint32_t writes = hostRegisterWrites;
+  display.writeToSSeg(score);
+  count(costOf("writeToSSeg"), hostRegisterWrites - writes, hostTime - start);
+}
+
+/*
+A new LCD message: the call's own cost and, as the queue runs, its share of the LCD task's work
+*/
+void beginMessage(const char *name) {
+  if (message.cost != 0) {
+    message.cost->replaced++;
+    count(message.cost, message.writes, message.cpu);
+  }
+  message.cost = costOf(name);
+  message.start = hostTime;
+  message.writes = hostRegisterWrites;
+  message.cpu = 0;
+}
+
+void endMessage() {
+  if (message.cost == 0) {
+    return;
+  }
+  uint64_t screen = lcd->readyTime() - message.start;
+  message.cost->shown++;
+  message.cost->screen += screen;
+  if (screen > message.cost->mostScreen) {
+    message.cost->mostScreen = screen;
+  }
+  count(message.cost, message.writes, message.cpu);
+  message.cost = 0;
+}
+
+void writeToLCD(const char *text) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%s", text);
+  uint64_t start = hostTime;
+  uint32_t writes = hostRegisterWrites;
+  beginMessage("writeToLCD");
+  display.writeToLCD(buffer);
+  message.writes = hostRegisterWrites - writes;
+  message.cpu = hostTime - start;
+}
+
+void gameMessage(int score) {
+  uint64_t start = hostTime;
+  uint32_t writes = hostRegisterWrites;
+  beginMessage("gameMessage");
+  display.gameMessage(score);
+  message.writes = hostRegisterWrites - writes;
+  message.cpu = hostTime - start;
+}
+
+/*
+Runs the LCD task until the given time: bursts of lcdInterruptCheck(), sleeping through waits of a millisecond or more
+and yielding through shorter ones, as lcdTaskRun() in the .ino does (the scheduler's own overhead is left out)
+*/
+void runUntil(uint64_t until) {
+  while (hostTime < until) {
+    if (!display.lcdInterruptActive) {
+      hostAdvance(until - hostTime);
+      break;
+    }
+    uint64_t start = hostTime;
+    uint32_t writes = hostRegisterWrites;
+    display.lcdInterruptCheck();
+    message.writes += hostRegisterWrites - writes;
+    message.cpu += hostTime - start;
+    if (!display.lcdInterruptActive) {
+      endMessage();
+      continue;
+    }
+    uint16_t wait = display.lcdWaitTime();
+    uint64_t sleep = wait >= 1000 ? (uint64_t)(wait / 1000 + 1) * 1000000000 : (uint64_t)wait * 1000000;
+    hostAdvance(until - hostTime < sleep ? until - hostTime : sleep);
+  }
+}
+
+void runUntilIdle() {
+  while (display.lcdInterruptActive) {
+    runUntil(hostTime + 1000000000ULL);
+  }
+}
+
+void traceSignals() {
+  serSignal = vcd.wire("arduino", "SER", 1);
+  srclkSignal = vcd.wire("arduino", "SRCLK", 1);
+  rclkSignal = vcd.wire("arduino", "RCLK", 1);
+  srclrSignal = vcd.wire("arduino", "SRCLR_n", 1);
+  oeSignal = vcd.wire("arduino", "OE_n", 1);
+  for (uint8_t chip = 0; chip < EmulatedDisplay::chips; chip++) {
+    char name[16];
+    snprintf(name, sizeof(name), "chip%d_QA_QH", chip);
+    chipSignals[chip] = vcd.wire("hc595", name, 8);
+  }
+  rsSignal = vcd.wire("lcd", "RS", 1);
+  rwSignal = vcd.wire("lcd", "RW", 1);
+  enableSignal = vcd.wire("lcd", "E", 1);
+  dataSignal = vcd.wire("lcd", "DB", 8);
+  busySignal = vcd.wire("lcd", "busy", 1);
+}
+
+// The digit a 7-segment pattern from scoreToDigits() shows
+char segmentDigit(uint8_t pattern) {
+  static const uint8_t digits[10] = {
+    0b11111100, 0b01100000, 0b11011010, 0b11110010, 0b01100110, 0b10110110, 0b10111110, 0b11100000, 0b11111110, 0b11110110
+  };
+  pattern &= 0xFE;
+  if (pattern == 0) {
+    return ' ';
+  }
+  for (uint8_t i = 0; i < 10; i++) {
+    if (digits[i] == pattern) {
+      return '0' + i;
+    }
+  }
+  return '?';
+}
+
+void report() {
+  printf("\n%-12s %6s %8s %8s %10s %10s %10s %10s %8s\n", "call", "calls", "writes", "max", "cpu us", "max",
+    "screen us", "max", "replaced");
+  for (Cost &cost : costs) {
+    printf("%-12s %6u %8u %8u %10.1f %10.1f", cost.name.c_str(), cost.calls, cost.writes / cost.calls, cost.mostWrites,
+      cost.cpu / 1e6 / cost.calls, cost.mostCpu / 1e6);
+    if (cost.shown > 0) {
+      printf(" %10.1f %10.1f %8u\n", cost.screen / 1e6 / cost.shown, cost.mostScreen / 1e6, cost.replaced);
+    }
+    else if (cost.replaced > 0) {
+      printf(" %10s %10s %8u\n", "-", "-", cost.replaced);
+    }
+    else {
+      printf("\n");
+    }
+  }
+  printf("(writes and cpu of LCD messages include the queue work done for them, screen = call until the last character"
+    " has been executed)\n");
+  printf("display.cpp's own lcdMessageTime() of the last message: %lu us\n", display.lcdMessageTime());
+
+  printf("\n74HC595: %u shifts, %u latches\n", chain.shifts(), chain.latches());
+  printf("HD44780: %u instructions, %u characters\n", lcd->instructions(), lcd->characters());
+  printf("\n7-segment: [");
+  for (uint8_t chip = 0; chip < EmulatedDisplay::segmentChips; chip++) {
+    putchar(segmentDigit(chain.output(chip)));
+  }
+  printf("]\nLCD:       [%s]\n           [%s]\n\n", lcd->row(0).c_str(), lcd->row(1).c_str());
+}
+
+int main(int argc, char **argv) {
+  const char *tracePath = 0;
+  uint32_t oscillator = 270000;
+  int presses = 60;
+  int option;
+  while ((option = getopt(argc, argv, "o:c:f:n:")) != -1) {
+    switch (option) {
+      case 'o': tracePath = optarg; break;
+      case 'c': hostOverheadCycles = atoi(optarg); break;
+      case 'f': oscillator = atol(optarg); break;
+      case 'n': presses = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-o trace.vcd] [-c overhead cycles] [-f LCD oscillator Hz] [-n presses]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  Hd44780 controller(oscillator);
+  lcd = &controller;
+  if (tracePath != 0 && !vcd.open(tracePath)) {
+    fprintf(stderr, "can't write %s\n", tracePath);
+    return 2;
+  }
+  traceSignals();
+  hostPortListener = &portChanged;
+
+  // Boot: the LCD gets its power with the board, the boot task waits lcdPowerUpTime before the displays
+  lcd->powerOn(0);
+  delay(40);
+  // The settings the initialization queues are done as a part of the first message
+  uint64_t start = hostTime;
+  uint32_t writes = hostRegisterWrites;
+  display.initializeDisplays();
+  count(costOf("initialize"), hostRegisterWrites - writes, hostTime - start);
+  writeToLCD("Yhden vai kahdentonnin haaste?");
+  runUntilIdle();
+
+  // The player presses start a second later
+  runUntil(hostTime + 1000000000000ULL);
+  latencyStart();
+  writeToSSeg(0);
+  gameMessage(0);
+
+  // One press per game tick, the tick gets 10 % faster every ten points like in the game
+  uint64_t tick = 1000000000000ULL;
+  for (int score = 1; score <= presses; score++) {
+    runUntil(hostTime + tick);
+    // Only the display write is timed, the press itself goes through buttons.cpp and the scheduler on the board
+    latencyEdge();
+    writeToSSeg(score);
+    latencyMark(LATENCY_SCORE);
+    // The leds are driven straight from the pins, nothing to emulate between the two points
+    latencyMark(LATENCY_LED);
+    if (score % 10 == 0) {
+      tick = tick * 9 / 10;
+      gameMessage(score);
+    }
+  }
+
+  runUntil(hostTime + tick);
+  writeToLCD("Koitit ison etkäsaa penniäkään!");
+  runUntilIdle();
+  flushBusy(hostTime);
+  vcd.close();
+
+  report();
+  printf("Latency of the display write alone (edge marked right before writeToSSeg(), no button scan, settle or"
+    " scheduler), not held to the budget:\n");
+  latencyStop();
+  printf("\nTiming violations: 74HC595 %u, HD44780 %u (warnings %u)\n", chain.violations(), lcd->violations(),
+    lcd->warnings());
+  printf("Interrupts off at most %.1f us (sample interrupt every %.0f us)\n", hostInterruptsOffMax / 1e6,
+    interruptsOffBudget / 1e6);
+
+  if (chain.violations() > 0 || lcd->violations() > 0 || hostInterruptsOffMax > interruptsOffBudget) {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
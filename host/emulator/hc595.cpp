@@ -0,0 +1,107 @@
+#include "hc595.h"
+#include <stdio.h>
+
+// SN74HC595 switching limits at VCC = 4.5 V, 25 °C, in picoseconds
+static const uint32_t pulseWidth = 20000;        // SRCLK, RCLK high or low, SRCLR low
+static const uint32_t serSetup = 25000;          // SER before SRCLK rises
+static const uint32_t shiftBeforeLatch = 19000;  // SRCLK rising before RCLK rises
+static const uint32_t clearRecovery = 25000;     // SRCLR inactive before SRCLK rises
+
+Hc595Chain::Hc595Chain(uint8_t length) : shiftRegisters(length, 0), storageRegisters(length, 0) {
+}
+
+void Hc595Chain::check(uint64_t time, uint64_t since, uint32_t minimum, const char *what) {
+  if (since != 0 && time - since < minimum) {
+    violationCount++;
+    fprintf(stderr, "74HC595 @ %.3f us: %s %.1f ns, needs %.1f ns\n", time / 1e6, what, (time - since) / 1e3,
+      minimum / 1e3);
+  }
+}
+
+bool Hc595Chain::setInputs(uint64_t time, bool newSer, bool newSrclk, bool newRclk, bool newSrclr, bool newOe) {
+  bool changed = false;
+
+  if (newSer != ser) {
+    ser = newSer;
+    serChanged = time;
+  }
+
+  if (newSrclr != srclr) {
+    if (newSrclr) {
+      check(time, srclrChanged, pulseWidth, "SRCLR low for");
+    }
+    srclr = newSrclr;
+    srclrChanged = time;
+  }
+  // The clear is asynchronous and holds the shift registers at 0 for as long as it is low
+  if (!srclr) {
+    for (uint8_t &chip : shiftRegisters) {
+      chip = 0;
+    }
+  }
+
+  if (newSrclk != srclk) {
+    check(time, srclkChanged, pulseWidth, newSrclk ? "SRCLK low for" : "SRCLK high for");
+    if (newSrclk) {
+      check(time, serChanged, serSetup, "SER set up before SRCLK for");
+      check(time, srclrChanged, clearRecovery, "SRCLR released before SRCLK for");
+      if (srclr) {
+        // QA takes SER, everything else moves one step towards QH and QH moves on to the next chip
+        bool carry = ser;
+        for (uint8_t &chip : shiftRegisters) {
+          bool out = chip & 1;
+          chip = (chip >> 1) | (carry << 7);
+          carry = out;
+        }
+        shiftCount++;
+      }
+      srclkRose = time;
+    }
+    srclk = newSrclk;
+    srclkChanged = time;
+  }
+
+  if (newRclk != rclk) {
+    check(time, rclkChanged, pulseWidth, newRclk ? "RCLK low for" : "RCLK high for");
+    if (newRclk) {
+      check(time, srclkRose, shiftBeforeLatch, "SRCLK rise before RCLK rise");
+      if (storageRegisters != shiftRegisters) {
+        storageRegisters = shiftRegisters;
+        changed = true;
+      }
+      latchCount++;
+    }
+    rclk = newRclk;
+    rclkChanged = time;
+  }
+
+  if (newOe != oe) {
+    oe = newOe;
+    changed = true;
+  }
+  return changed;
+}
+
+uint8_t Hc595Chain::length() const {
+  return shiftRegisters.size();
+}
+
+uint8_t Hc595Chain::output(uint8_t chip) const {
+  return storageRegisters[chip];
+}
+
+bool Hc595Chain::outputsEnabled() const {
+  return !oe;
+}
+
+uint32_t Hc595Chain::violations() const {
+  return violationCount;
+}
+
+uint32_t Hc595Chain::shifts() const {
+  return shiftCount;
+}
+
+uint32_t Hc595Chain::latches() const {
+  return latchCount;
+}
@@ -0,0 +1,48 @@
+/*
+Pin-level model of a chain of 74HC595 serial-to-parallel shift registers, the way display.cpp drives them: SER into the
+first chip, each chip's QH' into the next chip's SER, and SRCLK, RCLK, SRCLR and OE shared by all of them.
+
+Outputs are given as one byte per chip with QA as bit 7 and QH as bit 0, which is the layout of Display::registers[], so
+chip n shows registers[n] once a whole update has been latched.
+
+Timing is checked against the SN74HC595 datasheet limits at VCC = 4.5 V (pulse widths and setup times), every violation
+is printed and counted.
+*/
+
+#ifndef HOST_HC595_H
+#define HOST_HC595_H
+
+#include <stdint.h>
+#include <vector>
+
+class Hc595Chain {
+  public:
+    explicit Hc595Chain(uint8_t length);
+
+    /*
+    New levels of the control inputs at the given time (picoseconds). srclr and oe are the active low pins as they are
+    on the wire. Returns true if the outputs changed
+    */
+    bool setInputs(uint64_t time, bool ser, bool srclk, bool rclk, bool srclr, bool oe);
+
+    uint8_t length() const;
+    uint8_t output(uint8_t chip) const;
+    // False while OE is high and the outputs float
+    bool outputsEnabled() const;
+
+    uint32_t violations() const;
+    uint32_t shifts() const;
+    uint32_t latches() const;
+
+  private:
+    void check(uint64_t time, uint64_t since, uint32_t minimum, const char *what);
+
+    std::vector<uint8_t> shiftRegisters;
+    std::vector<uint8_t> storageRegisters;
+    bool ser = false, srclk = false, rclk = false, srclr = true, oe = true;
+    // When each input last changed, and when SRCLK last rose
+    uint64_t serChanged = 0, srclkChanged = 0, rclkChanged = 0, srclrChanged = 0, srclkRose = 0;
+    uint32_t violationCount = 0, shiftCount = 0, latchCount = 0;
+};
+
+#endif
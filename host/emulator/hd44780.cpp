@@ -0,0 +1,270 @@
+#include "hd44780.h"
+#include <stdio.h>
+
+// Write cycle limits of the HD44780U datasheet at VCC = 4.5-5.5 V, in picoseconds
+static const uint64_t enableCycle = 500000;      // tcycE, rising edge to rising edge of E
+static const uint64_t enableHigh = 230000;       // PWEH
+static const uint64_t addressSetup = 40000;      // tAS, RS and R/W before E rises
+static const uint64_t addressHold = 10000;       // tAH, RS and R/W after E falls
+static const uint64_t dataSetup = 80000;         // tDSW, data before E falls
+static const uint64_t dataHold = 10000;          // tH, data after E falls
+// The internal reset keeps the controller busy for 10 ms after VCC has risen to 4.5 V, the datasheet asks to wait 15 ms
+static const uint64_t resetTime = 15000000000ULL;
+// Execution times at 270 kHz, in microseconds
+static const uint32_t longInstruction = 1520, shortInstruction = 37, addressUpdate = 4;
+
+Hd44780::Hd44780(uint32_t oscillator) : oscillator(oscillator) {
+  for (uint8_t &c : ddramContents) {
+    c = ' ';
+  }
+  for (uint8_t &c : cgramContents) {
+    c = 0;
+  }
+}
+
+void Hd44780::powerOn(uint64_t time) {
+  busyUntil = time + resetTime;
+}
+
+uint64_t Hd44780::scaled(uint32_t microseconds270) const {
+  return (uint64_t)microseconds270 * 1000000 * 270000 / oscillator;
+}
+
+void Hd44780::violation(uint64_t time, const char *what, uint64_t actual, uint64_t needed) {
+  violationCount++;
+  fprintf(stderr, "HD44780 @ %.3f us: %s %.3f us, needs %.3f us\n", time / 1e6, what, actual / 1e6, needed / 1e6);
+}
+
+void Hd44780::setPins(uint64_t time, bool newRs, bool newRw, bool newE, uint8_t newData) {
+  if (newRs != rs || newRw != rw) {
+    if (!e && eFell != 0 && time - eFell < addressHold) {
+      violation(time, "RS/RW held after E for", time - eFell, addressHold);
+    }
+    rs = newRs;
+    rw = newRw;
+    controlChanged = time;
+  }
+  if (newData != data) {
+    if (!e && eFell != 0 && time - eFell < dataHold) {
+      violation(time, "data held after E for", time - eFell, dataHold);
+    }
+    data = newData;
+    dataChanged = time;
+  }
+  if (newE != e) {
+    if (newE) {
+      if (time - controlChanged < addressSetup) {
+        violation(time, "RS/RW set up before E for", time - controlChanged, addressSetup);
+      }
+      if (eRose != 0 && time - eRose < enableCycle) {
+        violation(time, "E cycle", time - eRose, enableCycle);
+      }
+      eRose = time;
+    }
+    else {
+      if (time - eRose < enableHigh) {
+        violation(time, "E high for", time - eRose, enableHigh);
+      }
+      if (time - dataChanged < dataSetup) {
+        violation(time, "data set up before E falls for", time - dataChanged, dataSetup);
+      }
+      eFell = time;
+      // Writes are taken in on the falling edge
+      latch(time);
+    }
+    e = newE;
+  }
+}
+
+void Hd44780::latch(uint64_t time) {
+  // Reads of the busy flag and the address are allowed any time, and the game never reads data
+  if (rw) {
+    return;
+  }
+  if (time < busyUntil) {
+    violationCount++;
+    const char *what = instructionCount + characterCount == 0 ? "instruction during the power on reset"
+      : (rs ? "character while busy" : "instruction while busy");
+    fprintf(stderr, "HD44780 @ %.3f us: %s, %.3f us too early\n", time / 1e6, what, (busyUntil - time) / 1e6);
+    // A busy controller drops what it is given
+    return;
+  }
+  if (rs) {
+    writeData(time, data);
+  }
+  else {
+    execute(time, data);
+  }
+}
+
+void Hd44780::moveAddress(bool up) {
+  if (addressInCgram) {
+    address = (address + (up ? 1 : -1)) & 0x3F;
+    return;
+  }
+  if (!twoLines) {
+    address = up ? (address >= 0x4F ? 0 : address + 1) : (address == 0 ? 0x4F : address - 1);
+    return;
+  }
+  // The two lines are 0x00-0x27 and 0x40-0x67, the counter jumps from the end of one to the start of the other
+  if (up) {
+    address = address == 0x27 ? 0x40 : (address == 0x67 ? 0x00 : address + 1);
+  }
+  else {
+    address = address == 0x40 ? 0x27 : (address == 0x00 ? 0x67 : address - 1);
+  }
+}
+
+void Hd44780::writeData(uint64_t time, uint8_t value) {
+  characterCount++;
+  if (addressInCgram) {
+    cgramContents[address & 0x3F] = value;
+  }
+  else {
+    ddramContents[address & 0x7F] = value;
+    if (shiftDisplay) {
+      uint8_t width = twoLines ? 40 : 80;
+      displayShift = (displayShift + (increment ? 1 : width - 1)) % width;
+    }
+  }
+  moveAddress(increment);
+  busyUntil = time + scaled(shortInstruction + addressUpdate);
+}
+
+void Hd44780::execute(uint64_t time, uint8_t instruction) {
+  instructionCount++;
+  uint32_t duration = shortInstruction;
+
+  if (instruction & 0x80) {
+    // Set DDRAM address
+    address = instruction & 0x7F;
+    addressInCgram = false;
+  }
+  else if (instruction & 0x40) {
+    // Set CGRAM address
+    address = instruction & 0x3F;
+    addressInCgram = true;
+  }
+  else if (instruction & 0x20) {
+    // Function set, meant to be the first thing after the reset
+    if (instructionsSeen) {
+      warningCount++;
+      fprintf(stderr, "HD44780 @ %.3f us: function set 0x%02X after other instructions (datasheet: first)\n",
+        time / 1e6, instruction);
+    }
+    eightBit = instruction & 0x10;
+    twoLines = instruction & 0x08;
+    largeFont = instruction & 0x04;
+  }
+  else if (instruction & 0x10) {
+    // Cursor or display shift
+    uint8_t width = twoLines ? 40 : 80;
+    bool right = instruction & 0x04;
+    if (instruction & 0x08) {
+      displayShift = (displayShift + (right ? 1 : width - 1)) % width;
+    }
+    else {
+      moveAddress(right);
+    }
+  }
+  else if (instruction & 0x08) {
+    displayOn = instruction & 0x04;
+    cursorOn = instruction & 0x02;
+    blinkOn = instruction & 0x01;
+  }
+  else if (instruction & 0x04) {
+    increment = instruction & 0x02;
+    shiftDisplay = instruction & 0x01;
+  }
+  else if (instruction & 0x02) {
+    // Return home
+    address = 0;
+    addressInCgram = false;
+    displayShift = 0;
+    duration = longInstruction;
+  }
+  else if (instruction & 0x01) {
+    // Clear display, also sets the entry mode to increment
+    for (uint8_t &c : ddramContents) {
+      c = ' ';
+    }
+    address = 0;
+    addressInCgram = false;
+    displayShift = 0;
+    increment = true;
+    duration = longInstruction;
+  }
+  instructionsSeen = true;
+  busyUntil = time + scaled(duration);
+}
+
+bool Hd44780::busy(uint64_t time) const {
+  return time < busyUntil;
+}
+
+uint64_t Hd44780::readyTime() const {
+  return busyUntil;
+}
+
+std::string Hd44780::row(uint8_t number) const {
+  std::string text;
+  if (!displayOn || (number > 0 && !twoLines)) {
+    return std::string(16, ' ');
+  }
+  uint8_t width = twoLines ? 40 : 80;
+  for (uint8_t column = 0; column < 16; column++) {
+    uint8_t c = ddramContents[number * 0x40 + (column + displayShift) % width];
+    // The A00 character ROM is ASCII apart from a few places, and holds the Finnish letters up in the Japanese half
+    switch (c) {
+      case 0x5C: text += "¥"; break;
+      case 0x7E: text += "→"; break;
+      case 0x7F: text += "←"; break;
+      case 0xDF: text += "°"; break;
+      case 0xE1: text += "ä"; break;
+      case 0xE4: text += "µ"; break;
+      case 0xEF: text += "ö"; break;
+      case 0xF5: text += "ü"; break;
+      default:
+        if (c < 0x08) {
+          // One of the eight characters from CGRAM
+          text += "□";
+        }
+        else if (c >= 0x20 && c < 0x80) {
+          text += (char)c;
+        }
+        else {
+          text += "▒";
+        }
+        break;
+    }
+  }
+  return text;
+}
+
+uint8_t Hd44780::ddram(uint8_t address) const {
+  return ddramContents[address & 0x7F];
+}
+
+uint8_t Hd44780::cgram(uint8_t address) const {
+  return cgramContents[address & 0x3F];
+}
+
+uint8_t Hd44780::addressCounter() const {
+  return address;
+}
+
+uint32_t Hd44780::instructions() const {
+  return instructionCount;
+}
+
+uint32_t Hd44780::characters() const {
+  return characterCount;
+}
+
+uint32_t Hd44780::violations() const {
+  return violationCount;
+}
+
+uint32_t Hd44780::warnings() const {
+  return warningCount;
+}
@@ -0,0 +1,75 @@
+/*
+Model of an HD44780 LCD controller on an 8-bit bus (a 1602 module): the DDRAM and CGRAM, the address counter, the entry,
+display and function settings, and how long each instruction keeps the controller busy.
+
+The bus is checked against the write cycle timing of the Hitachi datasheet at VCC = 5 V, and everything that a real
+controller would get wrong is counted as a violation:
+  - an instruction or a character latched while the previous one is still executing (the busy flag would be set)
+  - an instruction during the internal reset after power on
+  - E pulse width, E cycle time, RS/RW setup before E and data setup before and hold after the falling edge of E
+Things that work on most modules but go against the datasheet are counted as warnings instead (a function set that is
+not the first instruction).
+
+The execution times scale with the oscillator: the datasheet gives them at 270 kHz, a module can run as slow as ~190 kHz.
+*/
+
+#ifndef HOST_HD44780_H
+#define HOST_HD44780_H
+
+#include <stdint.h>
+#include <string>
+
+class Hd44780 {
+  public:
+    explicit Hd44780(uint32_t oscillator = 270000);
+
+    // Starts the internal reset, times are in picoseconds from here on
+    void powerOn(uint64_t time);
+
+    // New levels on the bus, called whenever the driving outputs change
+    void setPins(uint64_t time, bool rs, bool rw, bool e, uint8_t data);
+
+    bool busy(uint64_t time) const;
+    // When the last instruction has been executed
+    uint64_t readyTime() const;
+
+    // What the 16 visible characters of a row show, as UTF-8
+    std::string row(uint8_t number) const;
+    uint8_t ddram(uint8_t address) const;
+    uint8_t cgram(uint8_t address) const;
+    uint8_t addressCounter() const;
+
+    uint32_t instructions() const;
+    uint32_t characters() const;
+    uint32_t violations() const;
+    uint32_t warnings() const;
+
+  private:
+    void latch(uint64_t time);
+    void execute(uint64_t time, uint8_t instruction);
+    void writeData(uint64_t time, uint8_t value);
+    void moveAddress(bool increment);
+    // Execution time in picoseconds of a datasheet time given at 270 kHz
+    uint64_t scaled(uint32_t microseconds270) const;
+    void violation(uint64_t time, const char *what, uint64_t actual, uint64_t needed);
+
+    uint32_t oscillator;
+    uint8_t ddramContents[128];
+    uint8_t cgramContents[64];
+    uint8_t address = 0;
+    bool addressInCgram = false;
+    bool increment = true, shiftDisplay = false;
+    bool displayOn = false, cursorOn = false, blinkOn = false;
+    bool eightBit = true, twoLines = false, largeFont = false;
+    uint8_t displayShift = 0;
+    bool instructionsSeen = false;
+
+    bool rs = false, rw = false, e = false;
+    uint8_t data = 0;
+    uint64_t busyUntil = 0;
+    uint64_t controlChanged = 0, dataChanged = 0, eRose = 0, eFell = 0;
+
+    uint32_t instructionCount = 0, characterCount = 0, violationCount = 0, warningCount = 0;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "vcd.h"
+
+// What an undriven or unknown signal is stored as
+static const int64_t released = -1, unknown = -2;
+
+VcdWriter::~VcdWriter() {
+  close();
+}
+
+bool VcdWriter::open(const char *path) {
+  file = fopen(path, "w");
+  return file != 0;
+}
+
+uint8_t VcdWriter::wire(const char *scope, const char *name, uint8_t width) {
+  // Identifiers are printable characters from '!' on, two of them once the single ones run out
+  uint8_t number = signals.size();
+  std::string code(1, (char)('!' + number % 94));
+  if (number >= 94) {
+    code += (char)('!' + number / 94);
+  }
+  signals.push_back({ scope, name, width, code, unknown });
+  return number;
+}
+
+void VcdWriter::define() {
+  defined = true;
+  if (file == 0) {
+    return;
+  }
+  fprintf(file, "$version SpedenSpelit host emulator $end\n$timescale 1ps $end\n");
+  std::string scope;
+  for (Signal &signal : signals) {
+    if (signal.scope != scope) {
+      if (!scope.empty()) {
+        fprintf(file, "$upscope $end\n");
+      }
+      scope = signal.scope;
+      fprintf(file, "$scope module %s $end\n", scope.c_str());
+    }
+    if (signal.width == 1) {
+      fprintf(file, "$var wire 1 %s %s $end\n", signal.code.c_str(), signal.name.c_str());
+    }
+    else {
+      fprintf(file, "$var wire %d %s %s [%d:0] $end\n", signal.width, signal.code.c_str(), signal.name.c_str(),
+        signal.width - 1);
+    }
+  }
+  if (!scope.empty()) {
+    fprintf(file, "$upscope $end\n");
+  }
+  fprintf(file, "$enddefinitions $end\n#0\n$dumpvars\n");
+  for (Signal &signal : signals) {
+    write(signal);
+  }
+  fprintf(file, "$end\n");
+  stamped = true;
+}
+
+void VcdWriter::stamp(uint64_t time) {
+  if (!stamped || time != lastTime) {
+    fprintf(file, "#%llu\n", (unsigned long long)time);
+    lastTime = time;
+    stamped = true;
+  }
+}
+
+void VcdWriter::write(Signal &signal) {
+  if (signal.width == 1) {
+    char level = signal.value == released ? 'z' : (signal.value == unknown ? 'x' : (signal.value ? '1' : '0'));
+    fprintf(file, "%c%s\n", level, signal.code.c_str());
+    return;
+  }
+  fputc('b', file);
+  for (int bit = signal.width - 1; bit >= 0; bit--) {
+    if (signal.value < 0) {
+      fputc(signal.value == released ? 'z' : 'x', file);
+    }
+    else {
+      fputc((signal.value >> bit) & 1 ? '1' : '0', file);
+    }
+  }
+  fprintf(file, " %s\n", signal.code.c_str());
+}
+
+void VcdWriter::change(uint64_t time, uint8_t signal, uint32_t value) {
+  if (!defined) {
+    define();
+  }
+  if (file == 0 || signal >= signals.size() || signals[signal].value == (int64_t)value) {
+    return;
+  }
+  stamp(time);
+  signals[signal].value = value;
+  write(signals[signal]);
+}
+
+void VcdWriter::release(uint64_t time, uint8_t signal) {
+  if (!defined) {
+    define();
+  }
+  if (file == 0 || signal >= signals.size() || signals[signal].value == released) {
+    return;
+  }
+  stamp(time);
+  signals[signal].value = released;
+  write(signals[signal]);
+}
+
+void VcdWriter::close() {
+  if (file != 0) {
+    fclose(file);
+    file = 0;
+  }
+}
@@ -0,0 +1,55 @@
+/*
+Writes signal changes as a Value Change Dump (IEEE 1364) that GTKWave and other waveform viewers open.
+
+HOW TO USE:
+  1. open() the file, then add every signal with wire() (signals of the same scope one after another)
+  2. change() whenever a signal gets a new value, with the time in picoseconds. Times must not go backwards
+  3. close() at the end
+*/
+
+#ifndef HOST_VCD_H
+#define HOST_VCD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class VcdWriter {
+  public:
+    ~VcdWriter();
+
+    bool open(const char *path);
+
+    // Returns the number to give to change(). width 1 is a single wire, anything wider a bus
+    uint8_t wire(const char *scope, const char *name, uint8_t width);
+
+    void change(uint64_t time, uint8_t signal, uint32_t value);
+
+    // The signal is not driven (high impedance)
+    void release(uint64_t time, uint8_t signal);
+
+    void close();
+
+  private:
+    struct Signal {
+      std::string scope;
+      std::string name;
+      uint8_t width;
+      std::string code;
+      int64_t value;
+    };
+
+    // Writes the header and the starting values on the first change
+    void define();
+    void stamp(uint64_t time);
+    void write(Signal &signal);
+
+    FILE *file = 0;
+    std::vector<Signal> signals;
+    bool defined = false;
+    uint64_t lastTime = 0;
+    bool stamped = false;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Static RAM used by each file of the sketch (.data + .bss per translation unit) and the biggest variables.
+#
+# Build first with a known build directory, then point this at it:
+#   arduino-cli compile -b arduino:avr:uno --build-path /tmp/spede SpedenSpelit.V4.6
+#   host/ramreport.sh /tmp/spede
+#
+# .data is counted twice in a way: it takes RAM and its starting values also take flash.
+# The stack and the heap come on top of this, see ram.h for checking those on the board.
+
+build=${1:?usage: ramreport.sh <arduino build directory>}
+size=${AVR_SIZE:-avr-size}
+nm=${AVR_NM:-avr-nm}
+
+printf '%-28s %6s %6s %6s\n' file data bss total
+for object in "$build"/sketch/*.o "$build"/libraries/*/*.o "$build"/libraries/*/*/*.o "$build"/core/*.o; do
+  [ -f "$object" ] || continue
+  $size -A "$object" | awk -v name="$(basename "$object" .o)" '
+    $1 == ".data" { data += $2 }
+    $1 == ".bss" { bss += $2 }
+    END { if (data + bss > 0) printf "%-28s %6d %6d %6d\n", name, data, bss, data + bss }'
+done | sort -k4 -n -r
+
+elf=$(ls "$build"/*.elf 2>/dev/null | head -n 1)
+if [ -n "$elf" ]; then
+  echo
+  $size -C --mcu=atmega328p "$elf" 2>/dev/null || $size "$elf"
+  echo
+  echo "Biggest variables:"
+  $nm -S -C -t d --size-sort -r "$elf" | awk '$3 ~ /^[bBdD]$/ { name = $0; sub(/^[^ ]+ [^ ]+ [^ ]+ /, "", name); printf "%6d  %s\n", $2, name }' | head -n 15
+fi
@@ -0,0 +1,458 @@
+/*
+Monte-Carlo tuner for the speed curve. Plays millions of games with the sketch's own rules (game.cpp, the same file the
+box runs) against synthetic players, for every pair of candidate speed curve and player population, and prints the
+score and session length distributions of each pair.
+
+A player is a reaction time distribution and an error rate. The reaction times are ex-Gaussian (a normal part mu/sigma
+plus an exponential tail tau, all in ms), the usual fit for choice reaction times. The player reacts to the oldest lit
+target when it lights up, or right after the previous press if already behind. Every press goes to the wrong button with
+the probability error + lagError * (targets waiting - 1), as only the newest target is lit and the rest are remembered.
+The tick runs on whole milliseconds like the timer wheel, and a speed-up restarts it from the press like initializeTimer().
+Adaptive curves (game.h) get each press's time since the previous event like replayPress() gives it, and their period
+changes wait for the next tick like timerSetPeriod().
+
+The games of each pair are split into chunks. The chunks go round-robin into per-thread queues, and a thread whose
+queue runs dry steals from the others. Every chunk has its own random stream derived from the seed, the pair and the
+chunk number, and the results are integer sums. So the output is the same whatever the thread count and whichever
+thread ran what.
+
+HOW TO USE (in host/tuner):
+  g++ -std=gnu++11 -O2 -pthread -I../emulator -I../../SpedenSpelit.V4.6 tuner.cpp ../../SpedenSpelit.V4.6/game.cpp \
+    -o /tmp/spede-tuner
+  /tmp/spede-tuner [-g games per pair] [-j threads] [-s seed] [-m score cap] [-o results.csv]
+    [-c start_ms:step_hits:step_percent | -c a:start_ms:target_lag:min_ms]... [-p name:mu:sigma:tau:error:lag_error]...
+  Without -c the box's curves and a few variants are tried, without -p four made-up populations (replace them with fits
+  of real players' press times)
+*/
+
+#include <arduino.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "board.h"
+#include "game.h"
+
+struct Player {
+  std::string name;
+  double mu, sigma, tau;
+  double error, lagError;
+};
+
+struct Pair {
+  GameCurve curve;
+  Player player;
+};
+
+// Session lengths are counted in whole seconds up to this, longer ones go to the last bucket
+const uint32_t sessionBuckets = 3600;
+
+struct Result {
+  uint64_t games = 0;
+  uint64_t scoreSum = 0;
+  uint64_t sessionSum = 0;   // ms
+  uint64_t lostBehind = 0;
+  std::vector<uint64_t> scores;
+  std::vector<uint64_t> sessions;
+
+  void resize(uint32_t scoreCap) {
+    scores.assign(scoreCap + 1, 0);
+    sessions.assign(sessionBuckets + 1, 0);
+  }
+
+  void add(const Result &other) {
+    games += other.games;
+    scoreSum += other.scoreSum;
+    sessionSum += other.sessionSum;
+    lostBehind += other.lostBehind;
+    for (size_t i = 0; i < scores.size(); i++) {
+      scores[i] += other.scores[i];
+    }
+    for (size_t i = 0; i < sessions.size(); i++) {
+      sessions[i] += other.sessions[i];
+    }
+  }
+};
+
+/*
+xoshiro256** seeded through splitmix64
+*/
+class Random {
+  public:
+    explicit Random(uint64_t seed) {
+      for (uint64_t &word : state) {
+        seed += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        word = z ^ (z >> 31);
+      }
+    }
+
+    uint64_t next() {
+      uint64_t result = rotate(state[1] * 5, 7) * 9;
+      uint64_t t = state[1] << 17;
+      state[2] ^= state[0];
+      state[3] ^= state[1];
+      state[1] ^= state[2];
+      state[0] ^= state[3];
+      state[2] ^= t;
+      state[3] = rotate(state[3], 45);
+      return result;
+    }
+
+    // [0, 1)
+    double uniform() {
+      return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    uint32_t below(uint32_t limit) {
+      return (uint32_t)(((next() >> 32) * limit) >> 32);
+    }
+
+    double normal() {
+      // Box-Muller, one of the pair is enough here
+      double u = 1.0 - uniform();
+      return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * uniform());
+    }
+
+  private:
+    static uint64_t rotate(uint64_t x, int k) {
+      return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t state[4];
+};
+
+// A reaction in ms, nobody reacts to a light in under 100 ms
+uint32_t reaction(const Player &player, Random &random) {
+  double time = player.mu + player.sigma * random.normal() - player.tau * log(1.0 - random.uniform());
+  return time < 100 ? 100 : (uint32_t)(time + 0.5);
+}
+
+// The tick period in whole milliseconds like initializeTimer() gives it to the timer wheel
+uint32_t tickPeriod(long period) {
+  uint32_t ms = (period + 500) / 1000;
+  return ms == 0 ? 1 : ms;
+}
+
+/*
+Plays one game, adds it to the result
+*/
+void playGame(const Pair &pair, uint32_t scoreCap, Random &random, Result &result) {
+  GameState game;
+  gameReset(&game, &pair.curve);
+  // When the waiting targets were lit, oldest at litHead
+  uint32_t lit[GAME_HISTORY];
+  uint8_t litHead = 0;
+  uint32_t now = 0;
+  uint32_t lastEvent = 0;
+  uint32_t tickAt = tickPeriod(game.period);
+  bool pressing = false;
+  uint32_t pressAt = 0;
+  bool behind = false;
+
+  for (;;) {
+    // A tick at the same millisecond comes first, it's an interrupt
+    if (pressing && pressAt < tickAt) {
+      now = pressAt;
+      int8_t button = game.targets[game.waiting - 1];
+      if (random.uniform() < pair.player.error + pair.player.lagError * (game.waiting - 1)) {
+        button = (button + 1 + random.below(buttonCount - 1)) % buttonCount;
+      }
+      long oldPeriod = game.period;
+      uint8_t press = gamePress(&game, button, std::min<uint32_t>(now - lastEvent, 0xFFFF));
+      lastEvent = now;
+      if (press == GAME_MISS || game.score >= scoreCap) {
+        break;
+      }
+      litHead = (litHead + 1) % GAME_HISTORY;
+      if (game.period != oldPeriod && pair.curve.targetLag == 0) {
+        tickAt = now + tickPeriod(game.period);
+      }
+      pressing = game.waiting > 0;
+      if (pressing) {
+        pressAt = std::max(lit[litHead], now) + reaction(pair.player, random);
+      }
+    }
+    else {
+      now = tickAt;
+      if (gameTick(&game, random.below(buttonCount))) {
+        behind = true;
+        break;
+      }
+      lit[(litHead + game.waiting - 1) % GAME_HISTORY] = now;
+      lastEvent = now;
+      tickAt = now + tickPeriod(game.period);
+      if (!pressing) {
+        pressing = true;
+        pressAt = now + reaction(pair.player, random);
+      }
+    }
+  }
+
+  result.games++;
+  result.scoreSum += game.score;
+  result.sessionSum += now;
+  result.lostBehind += behind;
+  result.scores[std::min<uint32_t>(game.score, scoreCap)]++;
+  result.sessions[std::min<uint32_t>(now / 1000, sessionBuckets)]++;
+}
+
+struct Chunk {
+  uint32_t pair;
+  uint32_t number;
+  uint32_t games;
+};
+
+/*
+One queue per thread: the owner takes from the back, thieves from the front
+*/
+struct WorkQueue {
+  std::mutex lock;
+  std::deque<Chunk> chunks;
+
+  bool take(Chunk &chunk, bool steal) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (chunks.empty()) {
+      return false;
+    }
+    if (steal) {
+      chunk = chunks.front();
+      chunks.pop_front();
+    }
+    else {
+      chunk = chunks.back();
+      chunks.pop_back();
+    }
+    return true;
+  }
+};
+
+void work(uint32_t self, std::vector<WorkQueue> &queues, const std::vector<Pair> &pairs, uint64_t seed,
+  uint32_t scoreCap, std::vector<Result> &results) {
+  Chunk chunk;
+  for (;;) {
+    bool found = queues[self].take(chunk, false);
+    for (uint32_t i = 1; !found && i < queues.size(); i++) {
+      found = queues[(self + i) % queues.size()].take(chunk, true);
+    }
+    if (!found) {
+      return;
+    }
+    Random random(seed ^ ((uint64_t)chunk.pair << 40) ^ ((uint64_t)chunk.number * 0xD1B54A32D192ED03ULL));
+    for (uint32_t i = 0; i < chunk.games; i++) {
+      playGame(pairs[chunk.pair], scoreCap, random, results[chunk.pair]);
+    }
+  }
+}
+
+// The smallest value that at least the given share of the histogram is at or below
+uint32_t percentile(const std::vector<uint64_t> &histogram, uint64_t total, double share) {
+  uint64_t needed = (uint64_t)ceil(total * share);
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < histogram.size(); i++) {
+    seen += histogram[i];
+    if (seen >= needed && seen > 0) {
+      return i;
+    }
+  }
+  return histogram.size() - 1;
+}
+
+std::string curveName(const GameCurve &curve) {
+  char name[48];
+  if (curve.targetLag > 0) {
+    snprintf(name, sizeof(name), "a:%ld:%d:%ld", curve.startPeriod / 1000, curve.targetLag, curve.minPeriod / 1000);
+  }
+  else {
+    snprintf(name, sizeof(name), "%ld:%d:%d", curve.startPeriod / 1000, curve.stepHits, curve.stepPercent);
+  }
+  return name;
+}
+
+bool parseCurve(const char *text, GameCurve &curve) {
+  long start, minimum;
+  int hits, percent, lag;
+  if (strncmp(text, "a:", 2) == 0) {
+    if (sscanf(text + 2, "%ld:%d:%ld", &start, &lag, &minimum) != 3 || start <= 0 || lag < 1 || lag >= GAME_HISTORY ||
+        minimum < 1 || minimum > start) {
+      return false;
+    }
+    curve = adaptiveCurve;
+    curve.startPeriod = start * 1000;
+    curve.targetLag = lag;
+    curve.minPeriod = minimum * 1000;
+    return true;
+  }
+  if (sscanf(text, "%ld:%d:%d", &start, &hits, &percent) != 3 || start <= 0 || hits < 1 || hits > 255 || percent < 1 ||
+      percent > 100) {
+    return false;
+  }
+  curve = { start * 1000, (uint8_t)hits, (uint8_t)percent, 0, 0 };
+  return true;
+}
+
+bool parsePlayer(const char *text, Player &player) {
+  char name[32];
+  if (sscanf(text, "%31[^:]:%lf:%lf:%lf:%lf:%lf", name, &player.mu, &player.sigma, &player.tau, &player.error,
+      &player.lagError) != 6) {
+    return false;
+  }
+  player.name = name;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t gamesPerPair = 200000;
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t seed = 1;
+  uint32_t scoreCap = 1000;
+  const char *csvPath = 0;
+  std::vector<GameCurve> curves;
+  std::vector<Player> players;
+
+  int option;
+  while ((option = getopt(argc, argv, "g:j:s:m:o:c:p:")) != -1) {
+    switch (option) {
+      case 'g': gamesPerPair = strtoul(optarg, 0, 10); break;
+      case 'j': threads = std::max(1ul, strtoul(optarg, 0, 10)); break;
+      case 's': seed = strtoull(optarg, 0, 10); break;
+      case 'm': scoreCap = std::max(1ul, strtoul(optarg, 0, 10)); break;
+      case 'o': csvPath = optarg; break;
+      case 'c': {
+        GameCurve curve;
+        if (!parseCurve(optarg, curve)) {
+          fprintf(stderr, "bad curve %s, expected start_ms:step_hits:step_percent or a:start_ms:target_lag:min_ms\n",
+            optarg);
+          return 2;
+        }
+        curves.push_back(curve);
+        break;
+      }
+      case 'p': {
+        Player player;
+        if (!parsePlayer(optarg, player)) {
+          fprintf(stderr, "bad player %s, expected name:mu:sigma:tau:error:lag_error\n", optarg);
+          return 2;
+        }
+        players.push_back(player);
+        break;
+      }
+      default:
+        fprintf(stderr, "usage: %s [-g games] [-j threads] [-s seed] [-m score cap] [-o results.csv] "
+          "[-c start_ms:step_hits:step_percent | -c a:start_ms:target_lag:min_ms]... [-p name:mu:sigma:tau:error:lag_error]...\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (curves.empty()) {
+    curves.push_back(gameCurve);
+    curves.push_back({ 1000000, 10, 95, 0, 0 });
+    curves.push_back({ 1000000, 5, 95, 0, 0 });
+    curves.push_back({ 1200000, 10, 88, 0, 0 });
+    curves.push_back({ 800000, 10, 93, 0, 0 });
+    curves.push_back(adaptiveCurve);
+    curves.push_back({ 1000000, 10, 90, 2, 150000 });
+  }
+  if (players.empty()) {
+    players.push_back({ "beginner", 450, 70, 150, 0.010, 0.010 });
+    players.push_back({ "casual", 380, 55, 110, 0.006, 0.008 });
+    players.push_back({ "practised", 320, 45, 80, 0.004, 0.006 });
+    players.push_back({ "expert", 270, 35, 50, 0.002, 0.004 });
+  }
+
+  std::vector<Pair> pairs;
+  for (const GameCurve &curve : curves) {
+    for (const Player &player : players) {
+      pairs.push_back({ curve, player });
+    }
+  }
+
+  // Chunks go out round-robin, so every queue starts with a mix of cheap and expensive pairs
+  const uint32_t chunkGames = 5000;
+  std::vector<WorkQueue> queues(threads);
+  uint32_t next = 0;
+  for (uint32_t pair = 0; pair < pairs.size(); pair++) {
+    for (uint32_t number = 0; number * chunkGames < gamesPerPair; number++) {
+      uint32_t games = std::min(chunkGames, gamesPerPair - number * chunkGames);
+      queues[next++ % threads].chunks.push_back({ pair, number, games });
+    }
+  }
+
+  std::vector<std::vector<Result>> partial(threads, std::vector<Result>(pairs.size()));
+  for (std::vector<Result> &results : partial) {
+    for (Result &result : results) {
+      result.resize(scoreCap);
+    }
+  }
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < threads; i++) {
+    workers.emplace_back(work, i, std::ref(queues), std::cref(pairs), seed, scoreCap, std::ref(partial[i]));
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<Result> results(pairs.size());
+  for (uint32_t pair = 0; pair < pairs.size(); pair++) {
+    results[pair].resize(scoreCap);
+    for (uint32_t i = 0; i < threads; i++) {
+      results[pair].add(partial[i][pair]);
+    }
+  }
+
+  printf("%-12s %-10s %9s %7s %5s %5s %5s %5s %6s %8s %6s %6s %7s\n", "curve", "player", "games", "score", "p10", "p50",
+    "p90", "p99", "max", "session", "s p50", "s p90", "behind");
+  for (uint32_t pair = 0; pair < pairs.size(); pair++) {
+    const Result &result = results[pair];
+    uint32_t highest = 0;
+    for (uint32_t i = 0; i < result.scores.size(); i++) {
+      if (result.scores[i] > 0) {
+        highest = i;
+      }
+    }
+    printf("%-12s %-10s %9llu %7.1f %5u %5u %5u %5u %6u %7.1fs %5us %5us %6.1f%%\n", curveName(pairs[pair].curve).c_str(),
+      pairs[pair].player.name.c_str(), (unsigned long long)result.games, (double)result.scoreSum / result.games,
+      percentile(result.scores, result.games, 0.10), percentile(result.scores, result.games, 0.50),
+      percentile(result.scores, result.games, 0.90), percentile(result.scores, result.games, 0.99), highest,
+      result.sessionSum / 1000.0 / result.games, percentile(result.sessions, result.games, 0.50),
+      percentile(result.sessions, result.games, 0.90), 100.0 * result.lostBehind / result.games);
+  }
+  printf("(curve = start ms:hits per step:percent per step, or a:start ms:target lag:min period ms, score capped at %u, behind = lost by falling ten behind "
+    "rather than a wrong button)\n", scoreCap);
+
+  if (csvPath != 0) {
+    FILE *csv = fopen(csvPath, "w");
+    if (csv == 0) {
+      fprintf(stderr, "can't write %s\n", csvPath);
+      return 2;
+    }
+    // Long format, one row per non-empty histogram bucket
+    fprintf(csv, "curve,player,histogram,value,games\n");
+    for (uint32_t pair = 0; pair < pairs.size(); pair++) {
+      std::string curve = curveName(pairs[pair].curve);
+      const char *player = pairs[pair].player.name.c_str();
+      for (uint32_t i = 0; i < results[pair].scores.size(); i++) {
+        if (results[pair].scores[i] > 0) {
+          fprintf(csv, "%s,%s,score,%u,%llu\n", curve.c_str(), player, i, (unsigned long long)results[pair].scores[i]);
+        }
+      }
+      for (uint32_t i = 0; i < results[pair].sessions.size(); i++) {
+        if (results[pair].sessions[i] > 0) {
+          fprintf(csv, "%s,%s,session_s,%u,%llu\n", curve.c_str(), player, i,
+            (unsigned long long)results[pair].sessions[i]);
+        }
+      }
+    }
+    fclose(csv);
+  }
+  return 0;
+}